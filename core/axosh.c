@@ -13,8 +13,7 @@
 #include "../inc/user.h"
 // local prototype for kprintf
 void kprintf(const char* fmt, ...);
-/* snprintf is implemented in drv/vga.c, declare it here */
-int snprintf(char* out, size_t outsz, const char* fmt, ...);
+#include "../inc/format.h"
 /* forward declare password reader and util */
 static int read_password(const char *prompt, char *buf, int bufsize);
 static unsigned int parse_uint(const char *s);
@@ -24,6 +23,9 @@ void intel_chipset_reset(void);
 #include "../inc/thread.h"
 #include "../inc/editor.h"
 #include "../inc/sysinfo.h"
+#include "../inc/allocprof.h"
+#include "../inc/arena.h"
+#include "../inc/hashtab.h"
 
 typedef long ssize_t;
 
@@ -39,6 +41,7 @@ static char g_cwd[256] = "/";
 typedef struct { char name[32]; char* value; } osh_var;
 static osh_var g_vars[128];
 static int g_var_count = 0;
+static htab_t g_var_index;      // name -> osh_var*; entries are never removed, so names stay put
 
 static int is_var_name_char1(char c){ return (c=='_' || (c>='a'&&c<='z') || (c>='A'&&c<='Z')); }
 static int is_var_name_char(char c){ return (c=='_' || (c>='a'&&c<='z') || (c>='A'&&c<='Z') || (c>='0'&&c<='9')); }
@@ -50,16 +53,16 @@ static int is_valid_varname(const char* s){
     return 1;
 }
 
+static osh_var* var_find(const char* name){
+    if (g_var_index.slots) return (osh_var*)htab_get_str(&g_var_index, name);
+    for (int i=0;i<g_var_count;i++) if (strcmp(g_vars[i].name, name)==0) return &g_vars[i];
+    return NULL;
+}
+
 static int var_lookup(const char* name, const char** out_val){
-    if (!name) return 0;
-    for (int i=0;i<g_var_count;i++){
-        if (strcmp(g_vars[i].name, name)==0){
-            if (out_val) *out_val = g_vars[i].value ? g_vars[i].value : "";
-            return 1;
-        }
-    }
-    if (out_val) *out_val = "";
-    return 0;
+    osh_var* v = name ? var_find(name) : NULL;
+    if (out_val) *out_val = (v && v->value) ? v->value : "";
+    return v != NULL;
 }
 
 static const char* var_get(const char* name){
@@ -70,32 +73,27 @@ static const char* var_get(const char* name){
 
 static void var_set(const char* name, const char* value){
     if (!name) return;
-    for (int i=0;i<g_var_count;i++){
-        if (strcmp(g_vars[i].name, name)==0){
-            if (g_vars[i].value) kfree(g_vars[i].value);
-            size_t n = value ? strlen(value) : 0;
-            g_vars[i].value = (char*)kcalloc(n+1,1);
-            if (g_vars[i].value && value) memcpy(g_vars[i].value, value, n);
-            return;
-        }
-    }
-    if (g_var_count < (int)(sizeof(g_vars)/sizeof(g_vars[0]))){
-        strncpy(g_vars[g_var_count].name, name, sizeof(g_vars[g_var_count].name)-1);
-        g_vars[g_var_count].name[sizeof(g_vars[g_var_count].name)-1]='\0';
-        size_t n = value ? strlen(value) : 0;
-        g_vars[g_var_count].value = (char*)kcalloc(n+1,1);
-        if (g_vars[g_var_count].value && value) memcpy(g_vars[g_var_count].value, value, n);
+    osh_var* v = var_find(name);
+    if (!v && g_var_count < (int)(sizeof(g_vars)/sizeof(g_vars[0]))){
+        v = &g_vars[g_var_count];
+        strncpy(v->name, name, sizeof(v->name)-1);
+        v->name[sizeof(v->name)-1]='\0';
+        v->value = NULL;
+        if (!g_var_index.slots && g_var_count == 0) htab_init(&g_var_index, HTAB_KEY_STR, sizeof(g_vars)/sizeof(g_vars[0]));
+        // without the index var_find falls back to a scan, so a failed insert only costs speed
+        if (g_var_index.slots && htab_put_str(&g_var_index, v->name, v) != 0) htab_destroy(&g_var_index);
         g_var_count++;
     }
+    if (!v) return;
+    if (v->value) kfree(v->value);
+    size_t n = value ? strlen(value) : 0;
+    v->value = (char*)kcalloc(n+1,1);
+    if (v->value && value) memcpy(v->value, value, n);
 }
 
-static char* expand_vars(const char* in) {
-    if (!in) return NULL;
-    size_t n = strlen(in);
-    size_t cap = n + 1;
-    char* out = (char*)kmalloc(cap);
-    if (!out) return NULL;
-    size_t oi=0;
+// Expand $NAME references into 'out' (NULL only measures); returns the length
+static size_t expand_vars_into(const char* in, char* out) {
+    size_t n = strlen(in), oi = 0;
     for (size_t i=0;i<n;i++){
         if (in[i] == '$' && i+1 < n && is_var_name_char1(in[i+1])) {
             size_t j = i+1;
@@ -104,28 +102,30 @@ static char* expand_vars(const char* in) {
             name[k]='\0';
             const char* val = var_get(name);
             size_t vl = strlen(val);
-            // ensure capacity
-            if (oi + vl + 1 > cap) {
-                size_t ncap = cap; while (oi + vl + 1 > ncap) ncap *= 2;
-                char* nb = (char*)kmalloc(ncap);
-                if (!nb) { kfree(out); return NULL; }
-                if (oi) memcpy(nb, out, oi);
-                kfree(out); out = nb; cap = ncap;
-            }
-            if (vl) { memcpy(out+oi, val, vl); oi += vl; }
+            if (out && vl) memcpy(out+oi, val, vl);
+            oi += vl;
             i = j - 1;
             continue;
         }
-        if (oi + 2 > cap) {
-            size_t ncap = cap*2; char* nb=(char*)kmalloc(ncap); if (!nb){ kfree(out); return NULL; }
-            if (oi) memcpy(nb, out, oi); kfree(out); out=nb; cap=ncap;
-        }
-        out[oi++] = in[i];
+        if (out) out[oi] = in[i];
+        oi++;
     }
-    if (oi < cap) out[oi] = '\0'; else { char* nb=(char*)kmalloc(cap+1); if(nb){ memcpy(nb,out,cap); nb[cap]='\0'; kfree(out); out=nb; } }
+    if (out) out[oi] = '\0';
+    return oi;
+}
+
+// Result comes from 'a' when given (freed with the arena), otherwise from kmalloc
+static char* expand_vars_in(arena_t* a, const char* in) {
+    if (!in) return NULL;
+    size_t len = expand_vars_into(in, NULL);
+    char* out = a ? (char*)arena_alloc(a, len + 1) : (char*)kmalloc(len + 1);
+    if (!out) return NULL;
+    expand_vars_into(in, out);
     return out;
 }
 
+static char* expand_vars(const char* in) { return expand_vars_in(NULL, in); }
+
 // Replace bare identifiers with their variable values (for conditions like "a == 2")
 static char* osh_expand_idents(const char* in) {
     if (!in) return NULL;
@@ -252,10 +252,8 @@ static int line_is_brace_only(const char* s) {
     return 1;
 }
 
-static void osh_write(char **out, size_t *len, size_t *cap, const char *s) {
-    if (!s) return;
-    size_t add = strlen(s);
-    if (add == 0) return;
+static void osh_write_n(char **out, size_t *len, size_t *cap, const char *s, size_t add) {
+    if (!s || add == 0) return;
     size_t need = *len + add + 1;
     if (need > *cap) {
         size_t ncap = (*cap ? *cap : 128);
@@ -270,6 +268,10 @@ static void osh_write(char **out, size_t *len, size_t *cap, const char *s) {
     *len += add; (*out)[*len] = '\0';
 }
 
+static void osh_write(char **out, size_t *len, size_t *cap, const char *s) {
+    if (s) osh_write_n(out, len, cap, s, strlen(s));
+}
+
 // very simple join: if arg starts with '/', copy; else cwd + '/' + arg (no normalization)
 static void resolve_path(const char *cwd, const char *arg, char *out, size_t outlen);
 
@@ -295,6 +297,7 @@ static void resolve_path(const char *cwd, const char *arg, char *out, size_t out
         if (copy >= sizeof(tmp)) copy = sizeof(tmp) - 1;
         memcpy(tmp, arg, copy);
         tmp[copy] = '\0';
+        pos = copy;
     } else {
         size_t base_len = strlen(cwd);
         if (base_len >= sizeof(tmp)) base_len = sizeof(tmp) - 1;
@@ -325,29 +328,19 @@ static void resolve_path(const char *cwd, const char *arg, char *out, size_t out
         tmp[pos] = '\0';
     }
 
-    char *parts[64];
-    size_t plen[64];
+    str_span_t parts[64];
     int pc = 0;
-    char *cursor = tmp;
-    while (*cursor) {
-        while (*cursor == '/') cursor++;
-        if (!*cursor) break;
-        char *seg = cursor;
-        while (*cursor && *cursor != '/') cursor++;
-        size_t len = (size_t)(cursor - seg);
-        if (len == 0) { if (*cursor == '/') cursor++; continue; }
-        if (len == 1 && seg[0] == '.') {
+    str_iter_t it;
+    str_span_t seg;
+    str_iter_init_n(&it, tmp, pos, "/");
+    while (str_iter_next(&it, &seg)) {
+        if (seg.len == 1 && seg.ptr[0] == '.') {
             /* skip '.' */
-        } else if (len == 2 && seg[0] == '.' && seg[1] == '.') {
+        } else if (seg.len == 2 && seg.ptr[0] == '.' && seg.ptr[1] == '.') {
             if (pc > 0) pc--;
-        } else {
-            if (pc < (int)(sizeof(parts)/sizeof(parts[0]))) {
-                parts[pc] = seg;
-                plen[pc] = len;
-                pc++;
-            }
+        } else if (pc < (int)(sizeof(parts)/sizeof(parts[0]))) {
+            parts[pc++] = seg;
         }
-        if (*cursor == '/') cursor++;
     }
 
     if (pc == 0) {
@@ -358,7 +351,7 @@ static void resolve_path(const char *cwd, const char *arg, char *out, size_t out
 
     size_t w = 0;
     for (int i = 0; i < pc; i++) {
-        size_t seg_len = plen[i];
+        size_t seg_len = parts[i].len;
         if (w + 1 >= outlen) {
             out[outlen - 1] = '\0';
             return;
@@ -367,7 +360,7 @@ static void resolve_path(const char *cwd, const char *arg, char *out, size_t out
         size_t copy = seg_len;
         if (w + copy >= outlen) copy = outlen - 1 - w;
         if (copy > 0) {
-            memcpy(out + w, parts[i], copy);
+            memcpy(out + w, parts[i].ptr, copy);
             w += copy;
         }
     }
@@ -400,8 +393,23 @@ static int is_dir_path(const char *path) {
 typedef enum { T_WORD, T_AND, T_OR, T_PIPE, T_BG, T_GT, T_LT } tok_t;
 typedef struct { tok_t t; char *s; } token;
 
-static token* lex(const char *line, int *out_n) {
-    int cap = 16, n = 0; token *v = (token*)kcalloc((size_t)cap, sizeof(token));
+// Grow-by-copy in the arena; the old array is dropped with the rest of the line
+static int tok_push(arena_t *a, token **v, int *n, int *cap, token t) {
+    if (*n == *cap) {
+        token *nv = (token*)arena_alloc(a, (size_t)*cap * 2 * sizeof(token));
+        if (!nv) return -1;
+        memcpy(nv, *v, (size_t)*n * sizeof(token));
+        *v = nv; *cap *= 2;
+    }
+    (*v)[(*n)++] = t;
+    return 0;
+}
+
+// Tokens and their strings live in 'a' until the caller releases it
+static token* lex(arena_t *a, const char *line, int *out_n) {
+    *out_n = 0;
+    int cap = 16, n = 0; token *v = (token*)arena_alloc(a, (size_t)cap * sizeof(token));
+    if (!v) return NULL;
     const char *p = line; while (*p) {
         while (*p==' '||*p=='\t') p++;
         if (!*p) break;
@@ -420,16 +428,15 @@ static token* lex(const char *line, int *out_n) {
                 if (bi < (int)sizeof(buf)-1) buf[bi++] = *q++;
             }
             buf[bi]='\0';
-            char *ws = expand_vars(buf); if (!ws) { ws = (char*)kmalloc((size_t)bi+1); memcpy(ws, buf, (size_t)bi+1); }
-            if (n==cap){cap*=2; v=(token*)krealloc(v, (size_t)cap*sizeof(token));}
-            v[n++] = (token){T_WORD, ws};
+            char *ws = expand_vars_in(a, buf);
+            if (!ws || tok_push(a, &v, &n, &cap, (token){T_WORD, ws})) return NULL;
             p = q; // advance input pointer
             continue;
         }
-        if (p[0]=='&' && p[1]=='&') { if (n==cap){cap*=2; v=(token*)krealloc(v, (size_t)cap*sizeof(token));} v[n++] = (token){T_AND, NULL}; p+=2; continue; }
-        if (p[0]=='|' && p[1]=='|') { if (n==cap){cap*=2; v=(token*)krealloc(v, (size_t)cap*sizeof(token));} v[n++] = (token){T_OR, NULL}; p+=2; continue; }
-        if (*p=='|') { if (n==cap){cap*=2; v=(token*)krealloc(v, (size_t)cap*sizeof(token));} v[n++] = (token){T_PIPE, NULL}; p++; continue; }
-        if (*p=='&') { if (n==cap){cap*=2; v=(token*)krealloc(v, (size_t)cap*sizeof(token));} v[n++] = (token){T_BG, NULL}; p++; continue; }
+        if (p[0]=='&' && p[1]=='&') { if (tok_push(a, &v, &n, &cap, (token){T_AND, NULL})) return NULL; p+=2; continue; }
+        if (p[0]=='|' && p[1]=='|') { if (tok_push(a, &v, &n, &cap, (token){T_OR, NULL})) return NULL; p+=2; continue; }
+        if (*p=='|') { if (tok_push(a, &v, &n, &cap, (token){T_PIPE, NULL})) return NULL; p++; continue; }
+        if (*p=='&') { if (tok_push(a, &v, &n, &cap, (token){T_BG, NULL})) return NULL; p++; continue; }
         // Disable parsing of '>' and '<' as operators (to avoid conflict with color tags)
         // word (support quotes and Axon color tags like <(f0)>)
         const char *start = p; char buf[512]; int bi=0; int inq=0;
@@ -446,14 +453,29 @@ static token* lex(const char *line, int *out_n) {
             if (bi < (int)sizeof(buf)-1) buf[bi++] = *p; p++;
         }
         buf[bi] = '\0';
-        char *ws = expand_vars(buf); if (!ws) { ws = (char*)kmalloc((size_t)bi+1); memcpy(ws, buf, (size_t)bi+1); }
-        if (n==cap){cap*=2; v=(token*)krealloc(v, (size_t)cap*sizeof(token));}
-        v[n++] = (token){T_WORD, ws}; (void)start;
+        char *ws = expand_vars_in(a, buf);
+        if (!ws || tok_push(a, &v, &n, &cap, (token){T_WORD, ws})) return NULL;
+        (void)start;
     }
     *out_n = n; return v;
 }
 
-static void free_tokens(token *v, int n) { for (int i=0;i<n;i++) if (v[i].t==T_WORD && v[i].s) kfree(v[i].s); kfree(v); }
+// Per-line scratch arena of the interactive shell thread. Other threads (background
+// jobs) get a private arena for each line they run.
+static arena_t *g_line_arena = NULL;
+static thread_t *g_line_arena_owner = NULL;
+#define LINE_ARENA_CHUNK 4096
+
+static arena_t* line_arena_get(int *owned) {
+    *owned = 0;
+    if (g_line_arena && thread_current() == g_line_arena_owner) return g_line_arena;
+    *owned = 1;
+    return arena_create(LINE_ARENA_CHUNK);
+}
+
+static void line_arena_put(arena_t *a, int owned, arena_mark_t m) {
+    if (owned) arena_destroy(a); else arena_release(a, m);
+}
 
 // Forward declaration for script engine to call command executor
 int exec_line(const char *line);
@@ -1530,7 +1552,10 @@ static int bi_cat(cmd_ctx *c) {
     for (int i=1;i<c->argc;i++) {
         char path[256]; join_cwd(g_cwd, c->argv[i], path, sizeof(path)); struct fs_file *f = fs_open(path);
         if (!f) { osh_write(c->out, c->out_len, c->out_cap, "cat: no such file\n"); rc=1; continue; }
-        size_t want = f->size ? f->size : 0; char *buf = (char*)kmalloc(want+1); if (buf) { ssize_t r = fs_read(f, buf, want, 0); if (r>0) { buf[r]='\0'; osh_write(c->out, c->out_len, c->out_cap, buf); } kfree(buf);} fs_file_free(f);
+        // view the file in place instead of reading it into a temporary copy; stop at the first NUL like before
+        struct fs_map m;
+        if (fs_mmap(f, 0, 0, &m) == 0) { osh_write_n(c->out, c->out_len, c->out_cap, (const char*)m.addr, strnlen((const char*)m.addr, m.len)); fs_munmap(&m); }
+        fs_file_free(f);
     }
     return rc;
 }
@@ -1601,6 +1626,38 @@ static int bi_mem(cmd_ctx *c){
     else kprintf("RAM total: unknown\n");
     kprintf("Heap: used %u KB / total %u KB (peak %u KB)\n",
         (unsigned)(huse/1024u), (unsigned)(htot/1024u), (unsigned)(hpeak/1024u));
+    struct heap_frag_stats fs;
+    heap_get_frag_stats(&fs);
+    kprintf("Heap free: %u KB in %u blocks, largest %u KB\n",
+        (unsigned)(fs.free_bytes/1024u), (unsigned)fs.free_blocks, (unsigned)(fs.largest_free/1024u));
+    kprintf("krealloc: %u in place, %u shrunk, %u moved\n",
+        (unsigned)fs.realloc_inplace, (unsigned)fs.realloc_shrink, (unsigned)fs.realloc_moved);
+    return 0;
+}
+
+// htbench [n]: hash table insert/lookup/delete rates with n integer keys
+static int bi_htbench(cmd_ctx *c){
+    size_t n = 100000;
+    if (c->argc > 1) { n = (size_t)atoi(c->argv[1]); if (n == 0) { kprintf("usage: htbench [keys]\n"); return 1; } }
+    htab_benchmark(n);
+    return 0;
+}
+
+// memprof [live|count|bytes|rate] [reset]: top kmalloc callsites (KMALLOC_PROFILE=1 builds)
+static int bi_memprof(cmd_ctx *c){
+    int key = ALLOCPROF_SORT_LIVE;
+    for (int i = 1; i < c->argc; i++) {
+        if (strcmp(c->argv[i], "reset") == 0) { allocprof_reset(); continue; }
+        key = allocprof_parse_key(c->argv[i], strlen(c->argv[i]));
+        if (key < 0) { kprintf("usage: memprof [live|count|bytes|rate] [reset]\n"); return 1; }
+    }
+    size_t cap = 8192;
+    char *buf = (char*)kmalloc(cap + 1);
+    if (!buf) return 1;
+    size_t n = allocprof_format(buf, cap, key, 32);
+    buf[n] = '\0';
+    kprintf("%s", buf);
+    kfree(buf);
     return 0;
 }
 
@@ -1954,6 +2011,7 @@ static const builtin builtin_table[] = {
     {"ls", bi_ls}, {"cat", bi_cat}, {"mkdir", bi_mkdir}, {"touch", bi_touch}, {"rm", bi_rm},
     {"about", bi_about}, {"time", bi_time}, {"date", bi_date}, {"uptime", bi_uptime},
     {"edit", bi_edit}, {"reboot", bi_reboot}, {"shutdown", bi_shutdown}, {"mem", bi_mem},
+    {"memprof", bi_memprof}, {"htbench", bi_htbench},
     {"osh", bi_osh}, {"art", bi_art}, {"pause", bi_pause}, {"chipset", bi_chipset}, {"help", bi_help},
     {"passwd", bi_passwd}, {"su", bi_su}, {"whoami", bi_whoami}, {"mkpasswd", bi_mkpasswd}, {"groups", bi_groups},
     {"useradd", bi_useradd}, {"groupadd", bi_groupadd}, {"chmod", bi_chmod}
@@ -1997,8 +2055,20 @@ static int bi_chmod(cmd_ctx *c) {
     return 1;
 }
 
+static htab_t g_builtin_index;  // name -> builtin*, built on first lookup
+
 static builtin_fn find_builtin(const char* name) {
-    for (size_t i=0;i<sizeof(builtin_table)/sizeof(builtin_table[0]);i++) if (strcmp(builtin_table[i].name, name)==0) return builtin_table[i].fn;
+    size_t n = sizeof(builtin_table)/sizeof(builtin_table[0]);
+    if (!g_builtin_index.slots && htab_init(&g_builtin_index, HTAB_KEY_STR, n) == 0) {
+        for (size_t i=0;i<n;i++) {
+            if (htab_put_str(&g_builtin_index, builtin_table[i].name, (void*)&builtin_table[i]) != 0) { htab_destroy(&g_builtin_index); break; }
+        }
+    }
+    if (g_builtin_index.slots) {
+        const builtin* b = (const builtin*)htab_get_str(&g_builtin_index, name);
+        return b ? b->fn : NULL;
+    }
+    for (size_t i=0;i<n;i++) if (strcmp(builtin_table[i].name, name)==0) return builtin_table[i].fn;
     return NULL;
 }
 
@@ -2177,11 +2247,15 @@ static int osh_exec_subcommand(const char* line, char **out_value) {
         }
         return 0;
     }
+    int owned;
+    arena_t *a = line_arena_get(&owned);
+    if (!a) return 1;
+    arena_mark_t m = arena_mark(a);
     int tn = 0;
-    token *t = lex(line, &tn);
-    if (!t) return 1;
+    token *t = lex(a, line, &tn);
+    if (!t) { line_arena_put(a, owned, m); return 1; }
     if (tn == 0) {
-        free_tokens(t, tn);
+        line_arena_put(a, owned, m);
         if (out_value) {
             char* empty = (char*)kcalloc(1,1);
             if (!empty) *out_value = empty; else return 1;
@@ -2190,7 +2264,7 @@ static int osh_exec_subcommand(const char* line, char **out_value) {
     }
     char *out = NULL; size_t out_len = 0, out_cap = 0;
     int rc = exec_pipeline(t, 0, tn, NULL, &out, &out_len, &out_cap);
-    free_tokens(t, tn);
+    line_arena_put(a, owned, m);
     if (rc == 2 || rc == OSH_SCRIPT_EXIT || rc == OSH_SCRIPT_ABORT || rc == OSH_SCRIPT_RETURN) {
         if (out) kfree(out);
         return rc;
@@ -2473,7 +2547,7 @@ static int osh_eval_rhs(char* rhs, char** out_value) {
     return 0;
 }
 
-int exec_line(const char *line) {
+static int exec_line_in(arena_t *a, const char *line) {
     if (!line) return 0;
     const char* lp = line;
     while (*lp==' '||*lp=='\t') lp++;
@@ -2495,7 +2569,7 @@ int exec_line(const char *line) {
         g_script_return_pending = 1;
         return OSH_SCRIPT_RETURN;
     }
-    int tn=0; token *t = lex(line, &tn); if (tn==0) { if (t) kfree(t); return 0; }
+    int tn=0; token *t = lex(a, line, &tn); if (tn==0) return 0;
     int i=0; int status=0; // 0 success, non-zero fail; exit=2
     while (i < tn) {
         int j = i;
@@ -2503,15 +2577,15 @@ int exec_line(const char *line) {
         // execute segment [i,j)
         char *out=NULL; size_t out_len=0,out_cap=0;
         int rc = exec_pipeline(t, i, j, NULL, &out, &out_len, &out_cap);
-        if (rc == 2) { free_tokens(t, tn); if (out) kfree(out); return 2; }
-        if (rc == OSH_SCRIPT_EXIT) { free_tokens(t, tn); if (out) kfree(out); return OSH_SCRIPT_EXIT; }
-        if (rc == OSH_SCRIPT_ABORT) { free_tokens(t, tn); if (out) kfree(out); return OSH_SCRIPT_ABORT; }
-        if (rc == OSH_SCRIPT_RETURN) { free_tokens(t, tn); if (out) kfree(out); return OSH_SCRIPT_RETURN; }
+        if (rc == 2) { if (out) kfree(out); return 2; }
+        if (rc == OSH_SCRIPT_EXIT) { if (out) kfree(out); return OSH_SCRIPT_EXIT; }
+        if (rc == OSH_SCRIPT_ABORT) { if (out) kfree(out); return OSH_SCRIPT_ABORT; }
+        if (rc == OSH_SCRIPT_RETURN) { if (out) kfree(out); return OSH_SCRIPT_RETURN; }
         status = rc;
         // print to screen if there is output (and not redirected)
         if (out && out_len > 0) {
             // ensure 0-termination using a small temporary buffer to avoid heap resizing stalls
-            char *plain_tmp = (char*)kmalloc(out_len + 1);
+            char *plain_tmp = (char*)arena_alloc(a, out_len + 1);
             if (plain_tmp) { memcpy(plain_tmp, out, out_len); plain_tmp[out_len] = '\0'; }
             // If output contains Axon color tags <(...)>, use colorized printer;
             // otherwise use plain kprint. Do not interpret when redirected/ piped.
@@ -2521,14 +2595,13 @@ int exec_line(const char *line) {
             }
             if (use_color) {
                 // print from temporary padded buffer (avoid heap resizing)
-                char *tmp = (char*)kmalloc(out_len + 8);
-                if (tmp) { memcpy(tmp, out, out_len); memset(tmp + out_len, 0, 8); kprint_colorized(tmp); kfree(tmp); }
+                char *tmp = (char*)arena_alloc(a, out_len + 8);
+                if (tmp) { memcpy(tmp, out, out_len); memset(tmp + out_len, 0, 8); kprint_colorized(tmp); }
                 else if (plain_tmp) { kprint((uint8_t*)plain_tmp); }
             } else {
                 if (plain_tmp) { kprint((uint8_t*)plain_tmp); }
             }
             if (out[out_len-1] != '\n') kprint((uint8_t*)"\n");
-            if (plain_tmp) kfree(plain_tmp);
             kfree(out); out=NULL;
         }
         if (j == tn) break;
@@ -2539,10 +2612,19 @@ int exec_line(const char *line) {
         else if (t[j].t == T_OR) { if (status == 0) { int k = j+1; while (k<tn && t[k].t != T_AND && t[k].t != T_OR) k++; i = k; continue; } }
         i = j + 1;
     }
-    free_tokens(t, tn);
     return status;
 }
 
+int exec_line(const char *line) {
+    int owned;
+    arena_t *a = line_arena_get(&owned);
+    if (!a) return 1;
+    arena_mark_t m = arena_mark(a);
+    int rc = exec_line_in(a, line);
+    line_arena_put(a, owned, m);
+    return rc;
+}
+
 // -------- background jobs (minimal) --------
 typedef struct job { char *line; struct job *next; } job;
 static job *jobs_head = NULL;
@@ -2602,6 +2684,7 @@ void osh_run(void) {
     kprintf("%s v%s (%s)\n", OSH_NAME, OSH_VERSION, OSH_FULL_NAME);
     static char buf[512];
     osh_history_init();
+    if (!g_line_arena) { g_line_arena = arena_create(LINE_ARENA_CHUNK); g_line_arena_owner = thread_current(); }
     for (;;) {
         /* приглашение osh + строковый редактор */
         char prompt[128]; build_prompt(prompt, sizeof(prompt));
@@ -2609,12 +2692,22 @@ void osh_run(void) {
         if (n < 0) continue;
         char *line = buf;
         // Detect trailing background '&' at top level quickly; if present -> spawn job thread
-        int tn=0; token *t = lex(line, &tn); if (tn==0) { if (t) kfree(t); continue; }
-        int bg = (t[tn-1].t == T_BG);
-        free_tokens(t, tn);
+        int tn=0, owned; arena_t *a = line_arena_get(&owned); if (!a) continue;
+        arena_mark_t m = arena_mark(a);
+        token *t = lex(a, line, &tn);
+        int bg = (t && tn > 0 && t[tn-1].t == T_BG);
+        line_arena_put(a, owned, m);
+        if (tn==0) continue;
         if (!bg) osh_history_add(line);
-        if (bg) { job_push(line); thread_create(bg_thread_entry, "bg"); continue; }
-        int rc = exec_line(line); if (rc == 2) break; // exit
+        if (bg) {
+            job_push(line);
+            // фоновые задания ниже шелла по приоритету, чтобы не мешать вводу
+            thread_create_prio(bg_thread_entry, "bg", THREAD_PRIO_BACKGROUND);
+            continue;
+        }
+        int rc = exec_line(line);
+        if (g_line_arena) arena_reset(g_line_arena); // keep only the first chunk between lines
+        if (rc == 2) break; // exit
     }
 }
 
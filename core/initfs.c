@@ -8,6 +8,7 @@
 #include <fs.h>
 #include <ramfs.h>
 #include <heap.h>
+#include <crc32.h>
 #include "../inc/initfs.h"
 
 /* cpio newc header (ASCII hex fields) - 110 bytes total */
@@ -50,6 +51,29 @@ static int is_hex_string(const char *s, size_t n) {
     return 1;
 }
 
+/* "070702" archives carry c_check = 32-bit sum of all bytes of the file data
+   (the format is called "crc" but the value is a plain byte sum). Bytes are
+   added 8 at a time in 16-bit lanes; a lane can take 128 words before it
+   could overflow, then the lanes are folded into the total. */
+typedef uint64_t __attribute__((may_alias, aligned(1))) u64_unaligned;
+
+static uint32_t cpio_data_sum(const uint8_t *p, size_t n) {
+    uint32_t sum = 0;
+    while (n >= 8) {
+        size_t words = n / 8;
+        if (words > 128) words = 128;
+        uint64_t lanes = 0;
+        for (size_t i = 0; i < words; i++, p += 8) {
+            uint64_t w = *(const u64_unaligned*)p;
+            lanes += (w & 0x00FF00FF00FF00FFULL) + ((w >> 8) & 0x00FF00FF00FF00FFULL);
+        }
+        n -= words * 8;
+        sum += (uint32_t)((lanes & 0xFFFF) + ((lanes >> 16) & 0xFFFF) + ((lanes >> 32) & 0xFFFF) + (lanes >> 48));
+    }
+    while (n--) sum += *p++;
+    return sum;
+}
+
 /* Quick plausibility check for a cpio newc header.
    remaining = bytes available from header start to end of module. */
 static int plausible_cpio_header(const struct cpio_newc_header *h, size_t remaining) {
@@ -68,6 +92,7 @@ static int plausible_cpio_header(const struct cpio_newc_header *h, size_t remain
     if (!is_hex_string(h->c_rdevmajor, 8)) return 0;
     if (!is_hex_string(h->c_rdevminor, 8)) return 0;
     if (!is_hex_string(h->c_namesize, 8)) return 0;
+    if (!is_hex_string(h->c_check, 8)) return 0;
     /* parse namesize/filesize and verify bounds */
     uint32_t namesize = hex_to_uint(h->c_namesize, 8);
     uint32_t filesize = hex_to_uint(h->c_filesize, 8);
@@ -150,6 +175,7 @@ static int unpack_cpio_newc(const void *archive, size_t archive_size) {
     }
     if (found != 0) kprintf("initfs: cpio magic found at offset %u inside module, starting parse there\n", (unsigned)found);
     offset = found;
+    unsigned checked = 0, bad = 0;
 
     while (offset + sizeof(struct cpio_newc_header) <= archive_size) {
         const struct cpio_newc_header *h = (const struct cpio_newc_header*)(base + offset);
@@ -226,10 +252,23 @@ static int unpack_cpio_newc(const void *archive, size_t archive_size) {
             }
         } else if ((mode & 0170000u) == 0100000u) {
             /* regular file */
-            ensure_parent_dirs(target);
             const void *file_data = base + file_data_offset;
-            if (create_file_with_data(target, file_data, filesize) != 0) {
-                kprintf("initfs: failed to create %s (ignore)\n", target);
+            int intact = 1;
+            if (memcmp(magic, "070702", 6) == 0) {
+                uint32_t want = hex_to_uint(h->c_check, 8);
+                uint32_t got = cpio_data_sum((const uint8_t*)file_data, filesize);
+                checked++;
+                if (got != want) {
+                    kprintf("initfs: checksum mismatch for %s (have %08x, want %08x), skipped\n", target, got, want);
+                    bad++;
+                    intact = 0;
+                }
+            }
+            if (intact) {
+                ensure_parent_dirs(target);
+                if (create_file_with_data(target, file_data, filesize) != 0) {
+                    kprintf("initfs: failed to create %s (ignore)\n", target);
+                }
             }
         } else {
             /* other types (symlink, device...) - skip for now */
@@ -240,7 +279,8 @@ static int unpack_cpio_newc(const void *archive, size_t archive_size) {
         next = (next + 3) & ~3u;
         offset = next;
     }
-    return 0;
+    if (checked) kprintf("initfs: %u files checksummed, %u bad\n", checked, bad);
+    return bad ? -3 : 0;
 }
 
 /* Scan multiboot2 tags for module named `module_name` and unpack it. */
@@ -261,8 +301,9 @@ int initfs_process_multiboot_module(uint32_t multiboot_magic, uint32_t multiboot
             if (strcmp(name, module_name) == 0) {
                 size_t mod_size = mod_end > mod_start ? (size_t)(mod_end - mod_start) : 0;
                 const void *mod_ptr = (const void*)(uintptr_t)mod_start;
-                kprintf("initfs: found module '%s' at %p size %u\n", module_name, mod_ptr, (unsigned)mod_size);
                 if (mod_size == 0) return -2;
+                kprintf("initfs: found module '%s' at %p size %u crc32c %08x\n", module_name, mod_ptr,
+                        (unsigned)mod_size, crc32c(0, mod_ptr, mod_size));
                 return unpack_cpio_newc(mod_ptr, mod_size);
             }
         }
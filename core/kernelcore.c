@@ -10,8 +10,11 @@
 #include <rtc.h>
 #include <heap.h>
 #include <paging.h>
+#include <pmm.h>
 #include <sysinfo.h>
 #include <thread.h>
+#include <fpu.h>
+#include <timer.h>
 #include <axosh.h>
 #include <apic.h>
 #include <apic_timer.h>
@@ -127,8 +130,7 @@ static void resolve_path(const char *cwd, const char *arg, char *out, size_t out
     }
     /* normalize tmp into out (handle "." and "..") */
     /* algorithm: split by '/', push segments, pop on '..' */
-    char **parts = (char**)kmalloc(128);
-    if (!parts) return;
+    str_span_t parts[64];
     int pc = 0;
     char *s = tmp;
     /* ensure leading slash */
@@ -154,23 +156,17 @@ static void resolve_path(const char *cwd, const char *arg, char *out, size_t out
         s = tmp;
     }
     /* tokenize */
-    s++; /* skip leading slash */
-    while (*s) {
-        char *seg = s;
-        while (*s && *s != '/') s++;
-        size_t len = (size_t)(s - seg);
-        if (len == 0) { if (*s) s++; continue; }
-        char save = seg[len];
-        seg[len] = '\0';
-        if (strcmp(seg, ".") == 0) {
+    str_iter_t it;
+    str_span_t seg;
+    str_iter_init(&it, s, "/");
+    while (str_iter_next(&it, &seg)) {
+        if (seg.len == 1 && seg.ptr[0] == '.') {
             /* ignore */
-        } else if (strcmp(seg, "..") == 0) {
+        } else if (seg.len == 2 && seg.ptr[0] == '.' && seg.ptr[1] == '.') {
             if (pc > 0) pc--; /* pop */
-        } else {
+        } else if (pc < (int)(sizeof(parts)/sizeof(parts[0]))) {
             parts[pc++] = seg;
         }
-        seg[len] = save;
-        if (*s) s++;
     }
     /* build output */
     if (pc == 0) {
@@ -178,16 +174,14 @@ static void resolve_path(const char *cwd, const char *arg, char *out, size_t out
     } else {
         size_t pos = 0;
         for (int i = 0; i < pc; i++) {
-            size_t need = strlen(parts[i]) + 1; /* '/' + name */
+            size_t need = parts[i].len + 1; /* '/' + name */
             if (pos + need >= outlen) break;
             out[pos++] = '/';
-            size_t n = strlen(parts[i]);
-            memcpy(out + pos, parts[i], n);
-            pos += n;
+            memcpy(out + pos, parts[i].ptr, parts[i].len);
+            pos += parts[i].len;
         }
         out[pos] = '\0';
     }
-    kfree(parts);
 }
 
 static int is_dir_path(const char *path) {
@@ -238,6 +232,7 @@ void ascii_art() {
 }
 
 void kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
+    mem_init();
     kclear();
     kprint("Initializing kernel...\n");
     sysinfo_init(multiboot_magic, multiboot_info);
@@ -253,6 +248,7 @@ void kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
     idt_set_handler(APIC_TIMER_VECTOR, apic_timer_handler);
     
     paging_init();
+    pmm_init(multiboot_magic, multiboot_info);
     heap_init(0, 0);
 
     // Включаем прерывания
@@ -274,11 +270,15 @@ void kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
         kprintf("APIC: using PIT\n");
         apic_timer_stop();
     }
+    // kernel clock and timer wheel run off whichever source survived
+    timer_start(apic_timer_is_running() ? &apic_timer_source : NULL);
+    mem_benchmark();
 
     pci_init();
     pci_dump_devices();
     intel_chipset_init();
     thread_init();
+    fpu_init();
     iothread_init();
     
     /* user subsystem */
@@ -316,6 +316,7 @@ void kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
         sysfs_mount("/sys");
 
         pci_sysfs_init();
+        mm_sysfs_init();
         
         /* create /etc and write initial passwd/group files into ramfs */
         ramfs_mkdir("/etc");
@@ -347,6 +348,7 @@ void kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
         if (r == 0) kprintf("initfs: unpacked successfully\n");
         else if (r == 1) kprintf("initfs: initfs module not found or not multiboot2\n");
         else if (r == -1) kprintf("initfs: success\n");
+        else if (r == -3) kprintf("initfs: unpacked, files with bad checksums were skipped\n");
     }
 
     ps2_keyboard_init();
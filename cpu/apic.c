@@ -1,3 +1,6 @@
+// apic_eoi is called from interrupt handlers
+#pragma GCC target("general-regs-only")
+
 #include <apic.h>
 #include <stdio.h>
 
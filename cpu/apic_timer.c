@@ -1,13 +1,31 @@
+// The tick handler runs on top of whatever thread was interrupted; its xmm
+// registers belong to that thread (lazy FPU, see fpu.h)
+#pragma GCC target("general-regs-only")
+
 #include <apic_timer.h>
 #include <apic.h>
 #include <pit.h>
 #include <thread.h>
+#include <timer.h>
 #include <stdio.h>
 #include <string.h>
 
 volatile uint64_t apic_timer_ticks = 0;
 apic_timer_state_t apic_timer_state = {0};
 
+// Periodic tick as last programmed by apic_timer_start, to resume it after NO_HZ
+static uint8_t period_divider = 0;
+static uint32_t period_count = 0;
+static uint32_t period_us = 0;
+// Last one-shot: initial count and its length in microseconds
+static uint32_t oneshot_count = 0;
+static uint32_t oneshot_us = 0;
+// The one-shot was armed by the kernel clock (NO_HZ), not by a caller of apic_timer_start_oneshot
+static bool nohz_armed = false;
+// The one-shot expired with interrupts off and was already credited by
+// source_periodic; its interrupt is still pending and must not count again
+static bool swallow_tick = false;
+
 // Timer divider values (encoded for APIC timer divider register)
 static const uint8_t apic_dividers[] = {0x3, 0x0, 0x1, 0x2, 0x8, 0x9, 0xA, 0xB};
 static const uint32_t divider_values[] = {16, 2, 4, 8, 32, 64, 128, 1};
@@ -164,11 +182,76 @@ uint64_t apic_timer_get_uptime_seconds(void) {
     return apic_timer_get_time_ms() / 1000;
 }
 
+static void program_periodic(void) {
+    apic_write(LAPIC_TIMER_DIV_REG, period_divider);
+    apic_write(LAPIC_TIMER_INIT_REG, period_count);
+    apic_set_lvt_timer(APIC_TIMER_VECTOR, APIC_TIMER_PERIODIC, false);
+    apic_timer_state.mode = APIC_TIMER_PERIODIC;
+}
+
+// ---- kernel clock source (NO_HZ) ----
+
+static uint32_t source_elapsed_us(void) {
+    uint32_t cur = apic_read(LAPIC_TIMER_CURRENT_REG);
+    if (apic_timer_state.mode == APIC_TIMER_ONESHOT) {
+        if (!oneshot_count) return 0;
+        return (uint32_t)((uint64_t)(oneshot_count - cur) * oneshot_us / oneshot_count);
+    }
+    if (!period_count || cur > period_count) return 0;
+    return (uint32_t)((uint64_t)(period_count - cur) * period_us / period_count);
+}
+
+static uint32_t source_oneshot(uint32_t us) {
+    uint32_t elapsed = source_elapsed_us();
+    apic_timer_start_oneshot(us);
+    nohz_armed = true;
+    return elapsed;
+}
+
+static uint32_t source_periodic(void) {
+    // Masked, the one-shot can no longer raise an interrupt, so the IRR says
+    // exactly whether its expiry (credited in full below) is still undelivered
+    apic_set_lvt_timer(APIC_TIMER_VECTOR, APIC_TIMER_ONESHOT, true);
+    uint32_t elapsed = source_elapsed_us();
+    uint32_t irr = apic_read(LAPIC_IRR_REG + 0x10 * (APIC_TIMER_VECTOR / 32));
+    if (irr & (1u << (APIC_TIMER_VECTOR % 32))) swallow_tick = true;
+    nohz_armed = false;
+    program_periodic();
+    return elapsed;
+}
+
+const timer_source_t apic_timer_source = {
+    "apic",
+    source_elapsed_us,
+    source_oneshot,
+    source_periodic,
+};
+
 void apic_timer_handler(void) {
     apic_timer_ticks++;
     apic_timer_state.ticks = apic_timer_ticks;
-    if (init) thread_yield();
+    // EOI before switching: the next thread may run for a long time before
+    // this handler returns, and must keep receiving ticks meanwhile
     apic_eoi();
+    uint32_t us = period_us;
+    if (swallow_tick) {
+        swallow_tick = false;
+        return;
+    }
+    if (nohz_armed) {
+        // a periodic tick latched just before the switch to one-shot: its time
+        // was already accounted when the one-shot was armed
+        if (apic_read(LAPIC_TIMER_CURRENT_REG) != 0) return;
+        us = oneshot_us;
+        nohz_armed = false;
+        program_periodic();
+    }
+    timer_tick(us);
+    if (init) {
+        // nobody else to run: no preemption needed until the next timer
+        if (!thread_has_ready()) timer_nohz_enter();
+        thread_schedule();
+    }
 }
 
 void apic_timer_init(void) {    
@@ -211,26 +294,34 @@ void apic_timer_start(uint32_t freq_hz) {
     if (count > 0xFFFFF) count = 0xFFFFF;
     
     // Configure timer
-    apic_write(LAPIC_TIMER_DIV_REG, divider);
-    apic_write(LAPIC_TIMER_INIT_REG, count);
-    apic_set_lvt_timer(APIC_TIMER_VECTOR, APIC_TIMER_PERIODIC, false);
+    period_divider = divider;
+    period_count = count;
+    period_us = 1000000 / freq_hz;
+    nohz_armed = false;
+    swallow_tick = false;
+    program_periodic();
     
     // Update state
     apic_timer_state.frequency = freq_hz;
     apic_timer_state.running = true;
-    apic_timer_state.mode = APIC_TIMER_PERIODIC;
     apic_timer_ticks = 0;
 }
 
 void apic_timer_start_oneshot(uint32_t microseconds) {
     if (!apic_timer_state.calibrated) return;
     
-    uint32_t count = (apic_timer_state.base_frequency * microseconds) / 1000000;
+    // base_frequency is measured at divider 16; 64-bit so long delays don't wrap
+    uint64_t count = (uint64_t)apic_timer_state.base_frequency * microseconds / 1000000;
     if (count < 10) count = 10;
+    if (count > 0xFFFFFFFF) count = 0xFFFFFFFF;
+    oneshot_count = (uint32_t)count;
+    oneshot_us = apic_timer_state.base_frequency
+        ? (uint32_t)(count * 1000000 / apic_timer_state.base_frequency) : microseconds;
+    nohz_armed = false;
     
     apic_write(LAPIC_TIMER_DIV_REG, 0x3); // Divider 16
-    apic_write(LAPIC_TIMER_INIT_REG, count);
     apic_set_lvt_timer(APIC_TIMER_VECTOR, APIC_TIMER_ONESHOT, false);
+    apic_write(LAPIC_TIMER_INIT_REG, (uint32_t)count);
     
     apic_timer_state.running = true;
     apic_timer_state.mode = APIC_TIMER_ONESHOT;
@@ -255,11 +346,14 @@ uint64_t apic_timer_get_ticks(void) {
 }
 
 uint64_t apic_timer_get_time_ms(void) {
+    // ticks stop counting real time once NO_HZ can stretch them
+    if (timer_running()) return timer_now_ms();
     if (apic_timer_state.frequency == 0) return 0;
     return (apic_timer_ticks * 1000) / apic_timer_state.frequency;
 }
 
 uint64_t apic_timer_get_time_us(void) {
+    if (timer_running()) return timer_now_us();
     if (apic_timer_state.frequency == 0) return 0;
     return (apic_timer_ticks * 1000000) / apic_timer_state.frequency;
 }
@@ -277,6 +371,11 @@ bool apic_timer_is_calibrated(void) {
 }
 
 void apic_timer_sleep_ms(uint32_t ms) {
+    // with the kernel clock running, sleep in the scheduler instead of spinning
+    if (timer_running()) {
+        timer_sleep_ms(ms);
+        return;
+    }
     if (!apic_timer_state.running) {
         pit_sleep_ms(ms);
         return;
@@ -296,6 +395,14 @@ void apic_timer_sleep_us(uint32_t us) {
         }
         return;
     }
+    if (timer_running()) {
+        // the clock interpolates between ticks, so sub-tick waits are exact
+        uint64_t until = timer_now_us() + us;
+        while (timer_now_us() < until) {
+            asm volatile("pause");
+        }
+        return;
+    }
     
     uint64_t target_ticks = apic_timer_ticks + (us * apic_timer_state.frequency) / 1000000;
     while (apic_timer_ticks < target_ticks) {
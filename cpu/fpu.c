@@ -0,0 +1,205 @@
+#include <fpu.h>
+#include <thread.h>
+#include <idt.h>
+#include <heap.h>
+#include <string.h>
+
+// Этот файл работает, пока CR0.TS может быть взведён, поэтому компилятор не
+// должен сам вставлять сюда SSE-инструкции (иначе обработчик #NM вызовет #NM).
+#pragma GCC target("general-regs-only")
+
+#define CR0_MP   (1ULL << 1)
+#define CR0_EM   (1ULL << 2)
+#define CR0_TS   (1ULL << 3)
+#define CR4_OSXSAVE (1ULL << 18)
+
+#define XCR0_X87 (1ULL << 0)
+#define XCR0_SSE (1ULL << 1)
+#define XCR0_AVX (1ULL << 2)
+
+extern void kprintf(const char* fmt, ...);
+
+enum { FPU_NONE, FPU_FXSAVE, FPU_XSAVE, FPU_XSAVEOPT };
+
+static int fpu_mode = FPU_NONE;
+static size_t fpu_size = 0;
+static void* fpu_clean = NULL;          // состояние после fninit: его получает поток при первом обращении
+static thread_t* fpu_owner = NULL;      // чьё состояние сейчас в регистрах
+static int ts_set = 0;                  // копия CR0.TS, чтобы не читать CR0 на каждом переключении
+
+static inline void cpuid(uint32_t leaf, uint32_t sub, uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d) {
+        __asm__ volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(sub));
+}
+
+static inline uint64_t read_cr0(void) {
+        uint64_t v;
+        __asm__ volatile("mov %%cr0, %0" : "=r"(v));
+        return v;
+}
+
+static inline void write_cr0(uint64_t v) {
+        __asm__ volatile("mov %0, %%cr0" :: "r"(v) : "memory");
+}
+
+static inline void set_ts(void) {
+        write_cr0(read_cr0() | CR0_TS);
+        ts_set = 1;
+}
+
+static inline void clear_ts(void) {
+        __asm__ volatile("clts" ::: "memory");
+        ts_set = 0;
+}
+
+// все компоненты, разрешённые в XCR0
+static void fpu_save(void* area) {
+        switch (fpu_mode) {
+        case FPU_XSAVEOPT:
+                __asm__ volatile("xsaveopt64 (%0)" :: "r"(area), "a"(-1), "d"(-1) : "memory");
+                break;
+        case FPU_XSAVE:
+                __asm__ volatile("xsave64 (%0)" :: "r"(area), "a"(-1), "d"(-1) : "memory");
+                break;
+        default:
+                __asm__ volatile("fxsave64 (%0)" :: "r"(area) : "memory");
+                break;
+        }
+}
+
+static void fpu_restore(const void* area) {
+        if (fpu_mode >= FPU_XSAVE)
+                __asm__ volatile("xrstor64 (%0)" :: "r"(area), "a"(-1), "d"(-1) : "memory");
+        else
+                __asm__ volatile("fxrstor64 (%0)" :: "r"(area) : "memory");
+}
+
+void* fpu_state_alloc(void) {
+        if (!fpu_size) return NULL;
+        // XSAVE требует выравнивания на 64, FXSAVE на 16; заголовок XSAVE должен быть нулевым
+        void* area = kmalloc_aligned(fpu_size, 64);
+        if (area) memset(area, 0, fpu_size);
+        return area;
+}
+
+size_t fpu_state_size(void) {
+        return fpu_size;
+}
+
+// #NM: поток впервые после переключения выполнил FPU/SSE-инструкцию
+static void fpu_nm_handler(cpu_registers_t* regs) {
+        (void)regs;
+        clear_ts();
+        thread_t* cur = thread_current();
+        if (fpu_owner == cur) return;
+        if (fpu_owner && fpu_owner->fpu_state) fpu_save(fpu_owner->fpu_state);
+        fpu_owner = NULL;
+        // область выделяется при создании потока: куча в ловушке не реентерабельна
+        if (!cur) return;
+        if (cur->fpu_used && cur->fpu_state) {
+                fpu_restore(cur->fpu_state);
+        } else {
+                fpu_restore(fpu_clean);
+                cur->fpu_used = 1;
+        }
+        // без области сохранения поток пользуется регистрами, но владельцем не считается
+        if (cur->fpu_state) fpu_owner = cur;
+}
+
+void fpu_switch(thread_t* prev, thread_t* next) {
+        (void)prev;
+        if (!fpu_mode) return;
+        // владелец получает регистры как есть, остальные поймают #NM при первом обращении
+        if (next == fpu_owner) {
+                if (ts_set) clear_ts();
+        } else if (!ts_set) {
+                set_ts();
+        }
+}
+
+void fpu_release(thread_t* t) {
+        if (!t) return;
+        unsigned long flags;
+        __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        if (fpu_owner == t) fpu_owner = NULL;
+        t->fpu_used = 0;
+        __asm__ volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+void kernel_fpu_begin(unsigned long* flags) {
+        __asm__ volatile("pushfq; pop %0; cli" : "=r"(*flags) :: "memory");
+        if (!fpu_mode) return;
+        clear_ts();
+        if (fpu_owner) {
+                fpu_save(fpu_owner->fpu_state);
+                fpu_owner = NULL;
+        }
+}
+
+void kernel_fpu_end(unsigned long flags) {
+        // регистры испорчены: следующий пользователь FPU загрузит своё состояние через #NM
+        if (fpu_mode) set_ts();
+        __asm__ volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+const char* fpu_mode_name(void) {
+        switch (fpu_mode) {
+        case FPU_XSAVEOPT: return "xsaveopt";
+        case FPU_XSAVE:    return "xsave";
+        case FPU_FXSAVE:   return "fxsave";
+        default:           return "none";
+        }
+}
+
+void fpu_init(void) {
+        uint32_t a, b, c, d;
+        cpuid(1, 0, &a, &b, &c, &d);
+        int has_xsave = (c >> 26) & 1;
+        int has_avx = (c >> 28) & 1;
+
+        size_t size = 512;
+        int mode = FPU_FXSAVE;
+        if (has_xsave) {
+                uint64_t cr4;
+                __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+                __asm__ volatile("mov %0, %%cr4" :: "r"(cr4 | CR4_OSXSAVE) : "memory");
+                uint64_t xcr0 = XCR0_X87 | XCR0_SSE | (has_avx ? XCR0_AVX : 0);
+                __asm__ volatile("xsetbv" :: "c"(0), "a"((uint32_t)xcr0), "d"((uint32_t)(xcr0 >> 32)));
+                // EBX подпуска 0 — размер области для компонентов, включённых в XCR0 сейчас
+                cpuid(0xD, 0, &a, &b, &c, &d);
+                if (b > size) size = b;
+                cpuid(0xD, 1, &a, &b, &c, &d);
+                mode = (a & 1) ? FPU_XSAVEOPT : FPU_XSAVE;
+        }
+
+        uint64_t cr0 = read_cr0();
+        cr0 = (cr0 | CR0_MP) & ~(CR0_EM | CR0_TS);
+        write_cr0(cr0);
+        ts_set = 0;
+
+        fpu_mode = mode;
+        fpu_size = size;
+        fpu_clean = fpu_state_alloc();
+        if (!fpu_clean) {
+                fpu_mode = FPU_NONE;
+                fpu_size = 0;
+                kprintf("<(0c)>fpu: no memory for save areas, lazy switching disabled\n");
+                return;
+        }
+        uint32_t mxcsr = 0x1F80;    // все исключения SSE замаскированы
+        __asm__ volatile("fninit; ldmxcsr %0" :: "m"(mxcsr));
+        fpu_save(fpu_clean);
+
+        idt_set_handler(7, fpu_nm_handler);
+
+        // до этого момента FPU пользовались все подряд; считаем, что это был текущий поток
+        thread_t* cur = thread_current();
+        if (cur) {
+                cur->fpu_state = fpu_state_alloc();
+                if (cur->fpu_state) {
+                        cur->fpu_used = 1;
+                        fpu_owner = cur;
+                }
+        }
+        kprintf("fpu: %s, %lu-byte save area%s\n", fpu_mode_name(), (unsigned long)size,
+                has_avx && has_xsave ? ", avx" : "");
+}
@@ -58,6 +58,7 @@ isr%1:
         mov rax, %1
         push rax                        ; interrupt number
         mov rdi, rsp                ; rdi -> cpu_registers_t
+        cld                         ; C-код рассчитывает на DF=0; iretq вернёт прерванный флаг
         call isr_dispatch
         add rsp, 16                 ; pop vector + error code
         POP_REGS
@@ -76,6 +77,7 @@ isr%1:
         mov rax, %1
         push rax                        ; interrupt number
         mov rdi, rsp                ; rdi -> cpu_registers_t
+        cld                         ; C-код рассчитывает на DF=0; iretq вернёт прерванный флаг
         call isr_dispatch
         add rsp, 16                 ; убрать vector + дубликат error code
         POP_REGS
@@ -1,3 +1,7 @@
+// Диспетчер прерываний и обработчики исключений: без SSE, иначе они портят
+// xmm прерванного потока, а #NM внутри прерывания отдаёт регистры не тому
+#pragma GCC target("general-regs-only")
+
 #include <idt.h>
 #include <vga.h>
 #include <pic.h>
@@ -10,6 +14,8 @@
 #include <stddef.h>
 #include <apic_timer.h>
 #include <debug.h>
+#include <vm.h>
+#include <gdt.h>
 // Avoid including <cstdint> because cross-toolchain headers may not provide it; use uint64_t instead
 
 // Forward declare C-linkage helpers from other compilation units
@@ -22,6 +28,10 @@ static void (*isr_handlers[256])(cpu_registers_t*) = {NULL};
 
 static struct idt_entry_t idt[256];
 static struct idt_ptr_t idt_ptr;
+// Стек #DF (IST1): переполнение стека потока упирается в guard-страницу, и
+// #PF уже некуда положить кадр — #DF должен прийти на заведомо рабочий стек
+#define DF_STACK_SIZE 8192
+static uint8_t df_stack[DF_STACK_SIZE] __attribute__((aligned(16)));
 // сообщения об исключениях — определение для внешней декларации из idt.h
 const char* exception_messages[] = {
         "Division By Zero","Debug","Non Maskable Interrupt","Breakpoint","Into Detected Overflow",
@@ -77,6 +87,10 @@ static void div_zero_handler(cpu_registers_t* regs) {
 }
 
 static void page_fault_handler(cpu_registers_t* regs) {
+        uint64_t cr2 = 0;
+        read_crs(NULL, &cr2, NULL, NULL);
+        // first touch of a demand-zero page: back it and retry the access
+        if (vm_handle_fault(cr2, regs->error_code) == 0) return;
         kprint("PAGE FAULT\n");
         (void)regs;
         for (;;) { asm volatile("sti; hlt" ::: "memory"); }
@@ -99,6 +113,8 @@ static void gp_fault_handler(cpu_registers_t* regs){
 static void df_fault_handler(cpu_registers_t* regs){
         // Double Fault (#DF) — используем отдельный IST стек, чтобы избежать triple fault
         kprint("DOUBLE FAULT\n");
+        // RSP у самой нижней страницы стека потока — его переполнение
+        kprintf("<(0c)>RIP: %016lx\nRSP: %016lx\n", (unsigned long)regs->rip, (unsigned long)regs->rsp);
         // Застываем в безопасной петле с включёнными прерываниями
         for(;;){ asm volatile("sti; hlt" ::: "memory"); }
 }
@@ -178,6 +194,7 @@ void idt_init() {
         // Register DF handler (#8) and put it on IST1
         idt_set_handler(8, df_fault_handler);
         // Пометим IST=1 у вектора 8
+        tss_set_ist(1, (uint64_t)(df_stack + DF_STACK_SIZE));
         idt[8].ist = 1;
         
         // Register RTC handler (IRQ 8 = vector 40)
@@ -14,7 +14,7 @@ static int request_count = 0;
 static int iothread_initialized = 0;
 
 // I/O поток
-static struct thread_t* io_thread = NULL;
+static thread_t* io_thread = NULL;
 
 // Объявления внутренних функций
 static void io_worker_thread(void);
@@ -48,6 +48,12 @@ static void io_worker_thread(void) {
                         request = pending_queue;
                         pending_queue = pending_queue->next;
                         if (request) request->next = NULL;
+                } else {
+                        // блокируемся под замком: запрос, добавленный после
+                        // release, уже застанет нас BLOCKED и разбудит
+                        // io_thread присваивается после thread_create, а мы к тому
+                        // времени уже можем выполняться — берём свой tid напрямую
+                        thread_block((int)thread_current()->tid);
                 }
                 release_irqrestore(&io_lock, _flags);
                 
@@ -61,7 +67,7 @@ static void io_worker_thread(void) {
                         completed_queue = request;
                         release_irqrestore(&io_lock, _flags2);
                 } else {
-                        // Нет запросов - уступаем квант
+                        // Нет запросов - спим до iothread_schedule_request
                         thread_yield();
                 }
         }
@@ -118,6 +124,7 @@ int iothread_schedule_request(io_op_type_t type, uint8_t device_id, uint32_t off
         }
         int rid = request->id;
         release_irqrestore(&io_lock, _flags3);
+        if (io_thread) thread_unblock((int)io_thread->tid);
         
         return rid;
 }
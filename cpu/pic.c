@@ -1,3 +1,6 @@
+// pic_send_eoi вызывается из обработчиков прерываний
+#pragma GCC target("general-regs-only")
+
 #include <pic.h>
 #include <serial.h>
 
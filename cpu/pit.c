@@ -1,9 +1,13 @@
+// Обработчик IRQ0 не должен портить xmm прерванного потока
+#pragma GCC target("general-regs-only")
+
 #include <pit.h>
 #include <debug.h> 
 #include <pic.h>
 #include <idt.h>
 // VGA text mode uses hardware cursor; no backbuffer swap needed
 #include <thread.h>
+#include <timer.h>
 //#include <vbe.h>
 //#include <vbetty.h>
 
@@ -15,6 +19,7 @@ volatile uint32_t pit_frequency = 1000; // Default 100 Hz
 void pit_handler(cpu_registers_t* regs) {
         pit_ticks++;
         (void)regs;
+        timer_tick(1000000 / pit_frequency);
         
         // Вызываем планировщик реже - каждые 10 тиков (10 мс при 1000 Гц)
         if (init && (pit_ticks % 10 == 0)) {
@@ -85,6 +90,11 @@ uint16_t pit_get_current_count() {
 
 // Sleep for specified number of milliseconds
 void pit_sleep_ms(uint32_t milliseconds) {
+        // после запуска часов ядра спим через планировщик (PIT к тому времени может быть уже выключен)
+        if (timer_running()) {
+                timer_sleep_ms(milliseconds);
+                return;
+        }
         uint64_t target_ticks = pit_ticks + (milliseconds * pit_frequency / 1000);
         
         while (pit_ticks < target_ticks);
@@ -1,4 +1,6 @@
 // cpu/rtc.c
+// IRQ8: без SSE, чтобы не портить xmm прерванного потока
+#pragma GCC target("general-regs-only")
 
 #include <rtc.h>
 #include <serial.h>
@@ -1,3 +1,7 @@
+// Планировщик работает в прерывании таймера: gcc не должен векторизовать
+// здесь запись полей в xmm прерванного потока (см. fpu.h)
+#pragma GCC target("general-regs-only")
+
 #include <thread.h>
 #include <heap.h>
 #include <debug.h>
@@ -6,15 +10,269 @@
 #include <vga.h>
 #include <context.h>
 #include <debug.h>
+#include <pmm.h>
+#include <fpu.h>
+#include <hashtab.h>
+#include <paging.h>
+#include <timer.h>
 
-#define MAX_THREADS 32
-thread_t* threads[MAX_THREADS];
+// Реестр потоков: неупорядоченный растущий массив (для обхода) и хеш tid -> поток
+// (для поиска). TID выдаются по возрастанию и не переиспользуются.
+static thread_t** threads = NULL;
+static int thread_cap = 0;
 int thread_count = 0;
+static htab_t tid_index;
+static uint64_t next_tid = 1;
+// Завершённые потоки ждут, пока thread_reap освободит их стеки
+static thread_t* zombies = NULL;
 static thread_t* current = NULL;
 static thread_t* current_user = NULL; // регистрируемый юзер-процесс
 int init = 0;
 static thread_t main_thread;
 
+// ---- очереди готовых потоков ----
+// По FIFO-очереди на каждый уровень приоритета и битовая карта непустых
+// уровней: выбор следующего потока — один bsf, сколько бы потоков ни было.
+// Поток в состоянии READY всегда стоит в очереди своего уровня (prio),
+// у SLEEPING заведён sleep_timer; RUNNING, BLOCKED и TERMINATED — нигде.
+static thread_t* rq_head[THREAD_PRIO_LEVELS];
+static thread_t* rq_tail[THREAD_PRIO_LEVELS];
+static uint32_t rq_bitmap = 0;
+
+static inline unsigned long irq_save(void) {
+        unsigned long flags;
+        __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        return flags;
+}
+
+static inline void irq_restore(unsigned long flags) {
+        __asm__ volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+// Интерактивные потоки (часто ждут ввода, спят) получают надбавку к
+// приоритету, потоки, съедающие квант целиком, её теряют
+static inline void prio_boost(thread_t* t) {
+        if (t->bonus < THREAD_BONUS_MAX) t->bonus++;
+}
+
+static inline void prio_decay(thread_t* t) {
+        if (t->bonus) t->bonus--;
+}
+
+static void rq_push(thread_t* t) {
+        int p = (int)t->base_prio - (int)t->bonus;
+        if (p < 0) p = 0;
+        t->prio = (uint8_t)p;
+        t->rq_next = NULL;
+        t->rq_prev = rq_tail[p];
+        if (rq_tail[p]) rq_tail[p]->rq_next = t;
+        else rq_head[p] = t;
+        rq_tail[p] = t;
+        rq_bitmap |= 1u << p;
+}
+
+static void rq_remove(thread_t* t) {
+        int p = t->prio;
+        if (t->rq_prev) t->rq_prev->rq_next = t->rq_next;
+        else rq_head[p] = t->rq_next;
+        if (t->rq_next) t->rq_next->rq_prev = t->rq_prev;
+        else rq_tail[p] = t->rq_prev;
+        t->rq_next = t->rq_prev = NULL;
+        if (!rq_head[p]) rq_bitmap &= ~(1u << p);
+}
+
+static thread_t* rq_pop(void) {
+        if (!rq_bitmap) return NULL;
+        thread_t* t = rq_head[__builtin_ctz(rq_bitmap)];
+        rq_remove(t);
+        return t;
+}
+
+static void make_ready(thread_t* t) {
+        t->state = THREAD_READY;
+        rq_push(t);
+        // появился претендент на процессор: растянутый тик снова нужен
+        if (t != current) timer_nohz_exit();
+}
+
+int thread_has_ready(void) {
+        return rq_bitmap != 0;
+}
+
+// снять поток с очереди, в которой он стоит согласно состоянию
+static void dequeue(thread_t* t) {
+        if (t->state == THREAD_READY) rq_remove(t);
+        else if (t->state == THREAD_SLEEPING) timer_cancel(&t->sleep_timer);
+}
+
+// срабатывает в прерывании таймера
+static void sleep_expired(void* arg) {
+        thread_t* t = (thread_t*)arg;
+        if (t->state == THREAD_SLEEPING) make_ready(t);
+}
+
+// ---- реестр ----
+
+static int registry_add(thread_t* t) {
+        if (thread_count == thread_cap) {
+                int cap = thread_cap ? thread_cap * 2 : 32;
+                thread_t** grown = (thread_t**)krealloc(threads, (size_t)cap * sizeof(thread_t*));
+                if (!grown) return -1;
+                threads = grown;
+                thread_cap = cap;
+        }
+        if (htab_put_u64(&tid_index, t->tid, t) != 0) return -1;
+        t->slot = thread_count;
+        threads[thread_count++] = t;
+        return 0;
+}
+
+static void registry_remove(thread_t* t) {
+        htab_del_u64(&tid_index, t->tid);
+        // на место удалённого встаёт последний, порядок массива не важен
+        thread_t* last = threads[--thread_count];
+        threads[t->slot] = last;
+        last->slot = t->slot;
+}
+
+static thread_t* thread_find(int pid) {
+        if (pid < 0) return NULL;
+        return (thread_t*)htab_get_u64(&tid_index, (uint64_t)pid);
+}
+
+// Поток больше не выполняется (сам он, возможно, ещё на своём стеке)
+static void mark_terminated(thread_t* t) {
+        dequeue(t);
+        t->state = THREAD_TERMINATED;
+        fpu_release(t);
+        t->rq_next = zombies;
+        zombies = t;
+}
+
+// ---- кеш потоков ----
+// Завершённые потоки не освобождаются, а вместе со стеком и областью FPU
+// возвращаются в кеш; thread_create берёт оттуда готовый объект без походов
+// в кучу и pmm. Стек — блок pmm, нижняя страница которого снята с отображения:
+// переполнение даёт #PF (а с ним и #DF на IST-стеке) вместо порчи чужой памяти.
+#define THREAD_STACK_GUARD    1
+#define THREAD_STACK_ORDER    (THREAD_STACK_GUARD ? 2 : 1)   // 16 KiB: 4 KiB guard + 12 KiB стека
+#define THREAD_STACK_BLOCK    (PMM_FRAME_SIZE << THREAD_STACK_ORDER)
+#define THREAD_STACK_HEAP     8192    // запасной стек из кучи, без guard-страницы
+#define THREAD_CACHE_MAX      16
+#define THREAD_CACHE_PREWARM  4
+
+static thread_t* thread_cache = NULL;
+static int thread_cache_count = 0;
+
+static int stack_alloc(thread_t* t) {
+        uint64_t base = pmm_alloc_pages(THREAD_STACK_ORDER);
+#if THREAD_STACK_GUARD
+        // снять guard-страницу не удалось (расщепление большой страницы без
+        // свободных кадров) — такой блок не годится, берём стек из кучи
+        if (base && unmap_page_4k(base) != 0) {
+                pmm_free_pages(base, THREAD_STACK_ORDER);
+                base = 0;
+        }
+#endif
+        if (base) {
+                t->stack_base = base;
+                t->stack_pmm = 1;
+                t->kernel_stack = base + THREAD_STACK_BLOCK;
+                return 0;
+        }
+        base = (uint64_t)kmalloc(THREAD_STACK_HEAP + 16);
+        if (!base) return -1;
+        t->stack_base = base;
+        t->stack_pmm = 0;
+        t->kernel_stack = base + THREAD_STACK_HEAP;
+        return 0;
+}
+
+static void stack_free(thread_t* t) {
+        if (!t->stack_base) return;
+        if (t->stack_pmm) {
+#if THREAD_STACK_GUARD
+                // guard-страницу возвращаем в identity-отображение до освобождения блока
+                map_page_4k(t->stack_base, t->stack_base, 0);
+#endif
+                pmm_free_pages(t->stack_base, THREAD_STACK_ORDER);
+        } else {
+                kfree((void*)t->stack_base);
+        }
+        t->stack_base = 0;
+}
+
+static void thread_free(thread_t* t) {
+        stack_free(t);
+        if (t->fpu_state) kfree(t->fpu_state);
+        kfree(t);
+}
+
+// новый объект: thread_t, стек и (после fpu_init) область FPU
+static thread_t* thread_alloc(void) {
+        thread_t* t = (thread_t*)kmalloc(sizeof(thread_t));
+        if (!t) return NULL;
+        memset(t, 0, sizeof(thread_t));
+        if (stack_alloc(t) != 0) {
+                kfree(t);
+                return NULL;
+        }
+        t->fpu_state = fpu_state_alloc();
+        return t;
+}
+
+static void cache_put(thread_t* t) {
+        unsigned long flags = irq_save();
+        if (t->stack_base && thread_cache_count < THREAD_CACHE_MAX) {
+                t->rq_next = thread_cache;
+                thread_cache = t;
+                thread_cache_count++;
+                t = NULL;
+        }
+        irq_restore(flags);
+        if (t) thread_free(t);
+}
+
+static thread_t* cache_get(void) {
+        unsigned long flags = irq_save();
+        thread_t* t = thread_cache;
+        if (t) {
+                thread_cache = t->rq_next;
+                thread_cache_count--;
+        }
+        irq_restore(flags);
+        return t;
+}
+
+// Возвращает в кеш (или освобождает) завершённые потоки, кроме текущего.
+// Вызывается из контекста потока (создание потока, простой), не из прерываний.
+static void thread_reap(void) {
+        if (!zombies) return;
+        unsigned long flags = irq_save();
+        thread_t* list = zombies;
+        thread_t* dead = NULL;
+        zombies = NULL;
+        while (list) {
+                thread_t* t = list;
+                list = t->rq_next;
+                if (t == current) {
+                        t->rq_next = zombies;
+                        zombies = t;
+                        continue;
+                }
+                registry_remove(t);
+                if (t == current_user) current_user = NULL;
+                t->rq_next = dead;
+                dead = t;
+        }
+        irq_restore(flags);
+        while (dead) {
+                thread_t* t = dead;
+                dead = t->rq_next;
+                cache_put(t);
+        }
+}
+
 
 void thread_init() {
         memset(&main_thread, 0, sizeof(main_thread));
@@ -22,10 +280,17 @@ void thread_init() {
         main_thread.tid = 0;
         main_thread.context.rflags = 0x202; // ensure IF set for idle/main thread
         main_thread.sleep_until = 0;
+        main_thread.base_prio = THREAD_PRIO_DEFAULT;
+        main_thread.prio = THREAD_PRIO_DEFAULT;
         //for (int i=0;i<THREAD_MAX_FD;i++) main_thread.fds[i]=NULL;
         current = &main_thread;
-        threads[0] = &main_thread;
-        thread_count = 1;
+        htab_init(&tid_index, HTAB_KEY_U64, 32);
+        registry_add(&main_thread);
+        for (int i = 0; i < THREAD_CACHE_PREWARM; i++) {
+                thread_t* t = thread_alloc();
+                if (!t) break;
+                cache_put(t);
+        }
         strncpy(main_thread.name, "idle", sizeof(main_thread.name));
         /* default credentials: root */
         main_thread.euid = 0;
@@ -46,10 +311,12 @@ static void thread_trampoline(void) {
         //qemu_debug_printf("thread_trampoline: tid=%d start RFLAGS=0x%x\n", _tid, (unsigned int)_rflags);
         entry();
         
-        // Поток завершился - помечаем как завершенный
+        // Поток завершился - помечаем как завершенный; стек освободит thread_reap
         thread_t* self = thread_current();
         if (self) {
-                self->state = THREAD_TERMINATED;
+                unsigned long flags = irq_save();
+                mark_terminated(self);
+                irq_restore(flags);
         }
         
         // Переключаемся на другой поток
@@ -62,12 +329,30 @@ static void thread_trampoline(void) {
 }
 
 thread_t* thread_create(void (*entry)(void), const char* name) {
-        if (thread_count >= MAX_THREADS) return NULL;
-        thread_t* t = (thread_t*)kmalloc(sizeof(thread_t));
+        return thread_create_prio(entry, name, THREAD_PRIO_DEFAULT);
+}
+
+thread_t* thread_create_prio(void (*entry)(void), const char* name, int prio) {
+        if (prio < 0 || prio >= THREAD_PRIO_LEVELS) prio = THREAD_PRIO_DEFAULT;
+        thread_reap();
+        thread_t* t = cache_get();
+        if (!t) t = thread_alloc();
         if (!t) return NULL;
+        // от прошлой жизни объекта остаются только стек и область FPU
+        uint64_t stack_base = t->stack_base, kernel_stack = t->kernel_stack;
+        uint8_t stack_pmm = t->stack_pmm;
+        void* fpu_state = t->fpu_state;
         memset(t, 0, sizeof(thread_t));
         //for (int i=0;i<THREAD_MAX_FD;i++) t->fds[i]=NULL;
-        t->kernel_stack = (uint64_t)kmalloc(8192 + 16) + 8192;
+        t->stack_base = stack_base;
+        t->stack_pmm = stack_pmm;
+        t->kernel_stack = kernel_stack;
+        t->fpu_state = fpu_state ? fpu_state : fpu_state_alloc();
+        // без области сохранения поток не сможет пользоваться FPU: не создаём его
+        if (!t->fpu_state && fpu_state_size()) {
+                cache_put(t);
+                return NULL;
+        }
         uint64_t* stack = (uint64_t*)t->kernel_stack;
         // Ensure 16-byte alignment for the stack pointer before ret
         uint64_t sp = ((uint64_t)&stack[-1]) & ~0xFULL;
@@ -75,19 +360,26 @@ thread_t* thread_create(void (*entry)(void), const char* name) {
         t->context.rsp = sp;
         t->context.r12 = (uint64_t)entry; // entry передаётся через r12
         t->context.rflags = 0x202;
-        t->state = THREAD_READY;
         t->sleep_until = 0;
-        t->tid = thread_count;
+        // приоритет известен до постановки в очередь: первый тик уже его учитывает
+        t->base_prio = (uint8_t)prio;
         strncpy(t->name, name, sizeof(t->name));
         /* default credentials (root) */
         t->euid = 0;
         t->egid = 0;
-        threads[thread_count++] = t;
+        unsigned long flags = irq_save();
+        t->tid = next_tid++;
+        if (registry_add(t) != 0) {
+                irq_restore(flags);
+                cache_put(t);
+                return NULL;
+        }
+        make_ready(t);
+        irq_restore(flags);
         return t;
 }
 
 thread_t* thread_register_user(uint64_t user_rip, uint64_t user_rsp, const char* name){
-        if (thread_count >= MAX_THREADS) return NULL;
         // Sanity checks: reject clearly invalid user contexts (entry==0 or tiny stack)
         if (user_rip == 0 || user_rsp < 0x1000) {
                 kprintf("<(0c)>fatal: refusing to register user thread with invalid rip=0x%llx rsp=0x%llx\n",
@@ -103,116 +395,196 @@ thread_t* thread_register_user(uint64_t user_rip, uint64_t user_rsp, const char*
         t->user_stack = user_rsp;
         t->state = THREAD_RUNNING; // уже выполняется как текущее user‑задача
         t->sleep_until = 0;
-        t->tid = thread_count;
+        t->base_prio = THREAD_PRIO_DEFAULT;
         strncpy(t->name, name ? name : "user", sizeof(t->name));
         /* inherit credentials from current thread if available */
         if (current) { t->euid = current->euid; t->egid = current->egid; } else { t->euid = 0; t->egid = 0; }
-        threads[thread_count++] = t;
+        t->fpu_state = fpu_state_alloc();
+        if (!t->fpu_state && fpu_state_size()) {
+                kfree(t);
+                return NULL;
+        }
+        unsigned long flags = irq_save();
+        t->tid = next_tid++;
+        if (registry_add(t) != 0) {
+                irq_restore(flags);
+                thread_free(t);
+                return NULL;
+        }
+        irq_restore(flags);
         current_user = t;
         return t;
 }
 
+// Frames pre-zeroed per idle slice: small enough not to delay a pending wakeup
+#define IDLE_ZERO_BUDGET 8
+
+// Прерывания выключены с момента проверки условия ожидания до hlt: IRQ,
+// пришедшее в этом окне, разбудит hlt сразу, а не через растянутый тик
+void thread_idle(void) {
+        thread_reap();
+        if (pmm_zero_idle(IDLE_ZERO_BUDGET)) {
+                asm volatile("sti" ::: "memory");
+                return;
+        }
+        // есть готовые потоки — отдаём им процессор вместо hlt; ожидание ввода
+        // считается признаком интерактивного потока
+        if (rq_bitmap) {
+                asm volatile("sti" ::: "memory");
+                prio_boost(current);
+                thread_yield();
+                return;
+        }
+        // готовых нет: до ближайшего таймера тик не нужен
+        timer_nohz_enter();
+        asm volatile("sti; hlt; cli" ::: "memory");
+        timer_nohz_exit();
+        asm volatile("sti" ::: "memory");
+}
+
 thread_t* thread_current() {
         return current;
 }
 
+static void switch_to(thread_t* prev, thread_t* next) {
+        current = next;
+        next->state = THREAD_RUNNING;
+        if (next == prev) return;
+        //qemu_debug_printf("thread_schedule: switching from tid=%d to tid=%d\n", prev->tid, next->tid);
+        fpu_switch(prev, next);
+        context_switch(&prev->context, &next->context);
+}
+
+// tick: квант текущего потока истёк (вызывается из обработчика таймера), он
+// встаёт в очередь наравне с остальными и может продолжить, если он приоритетнее всех.
+// Иначе поток уступает процессор сам: любому готовому, даже менее приоритетному,
+// а если сам он больше не может выполняться и готовых нет, ждёт прерывания.
+static void schedule(int tick) {
+        unsigned long flags = irq_save();
+        thread_t* prev = current;
+        thread_t* next;
+        if (prev->state == THREAD_RUNNING) {
+                if (tick) {
+                        prio_decay(prev);
+                        make_ready(prev);
+                        next = rq_pop();
+                } else {
+                        next = rq_pop();
+                        if (next) make_ready(prev);
+                }
+                if (!next) { irq_restore(flags); return; }
+        } else {
+                // поток заблокирован, спит или завершён (или уже снова в очереди)
+                while (!(next = rq_pop())) {
+                        // из обработчика прерывания ждать нельзя: этим займётся сам поток
+                        if (tick) { irq_restore(flags); return; }
+                        timer_nohz_enter();
+                        asm volatile("sti; hlt; cli" ::: "memory");
+                        timer_nohz_exit();
+                        // пока ждали, таймер мог разбудить нас, а вложенный вызов из его
+                        // обработчика — переключиться на другие потоки и вернуться
+                        if (prev->state == THREAD_RUNNING) { irq_restore(flags); return; }
+                }
+        }
+        switch_to(prev, next);
+        irq_restore(flags);
+}
+
 void thread_yield() {
-        thread_schedule();
+        schedule(0);
+}
+
+void thread_schedule() {
+        schedule(1);
 }
 
 void thread_stop(int pid) {
-        for (int i = 0; i < thread_count; ++i) {
-                if (threads[i] && threads[i]->tid == pid && threads[i]->state != THREAD_TERMINATED) {
-                        threads[i]->state = THREAD_TERMINATED;
-                        return;
-                }
+        unsigned long flags = irq_save();
+        thread_t* t = thread_find(pid);
+        if (t && t->state != THREAD_TERMINATED) {
+                mark_terminated(t);
+                irq_restore(flags);
+                return;
         }
+        irq_restore(flags);
         kprintf("<(0c)>thread_stop: thread %d not found or already terminated\n", pid);
 }
 
 void thread_block(int pid) {
-        for (int i = 0; i < thread_count; ++i) {
-                if (threads[i] && threads[i]->tid == pid && threads[i]->state != THREAD_BLOCKED) {
-                        threads[i]->state = THREAD_BLOCKED;
-                        return;
-                }
+        unsigned long flags = irq_save();
+        thread_t* t = thread_find(pid);
+        if (t && t->state != THREAD_BLOCKED && t->state != THREAD_TERMINATED) {
+                dequeue(t);
+                t->state = THREAD_BLOCKED;
+                if (t == current) prio_boost(current);
+                irq_restore(flags);
+                return;
         }
+        irq_restore(flags);
         kprintf("<(0c)>thread_block: thread %d not found or already blocked\n", pid);
 }
 
 void thread_sleep(uint32_t ms) {
         if (ms == 0) return;
         
-        current->sleep_until = pit_ticks + ms;
+        // без часов будить некому
+        if (!timer_running()) { thread_yield(); return; }
+        unsigned long flags = irq_save();
+        current->sleep_until = timer_now_ms() + ms;
         current->state = THREAD_SLEEPING;
-        thread_yield();
+        timer_add(&current->sleep_timer, ms, sleep_expired, current);
+        prio_boost(current);
+        schedule(0);
+        irq_restore(flags);
 }
 
-void thread_schedule() {
-        // Сначала проверяем спящие потоки
-        for (int i = 0; i < thread_count; ++i) {
-                if (threads[i] && threads[i]->state == THREAD_SLEEPING) {
-                        if (pit_ticks >= threads[i]->sleep_until) {
-                                threads[i]->state = THREAD_READY;
-                        }
-                }
-        }
-        
-        int next = (current->tid + 1) % thread_count;
-        for (int i = 0; i < thread_count; ++i) {
-                int idx = (next + i) % thread_count;
-                if (threads[idx] && threads[idx]->state == THREAD_READY && threads[idx]->state != THREAD_TERMINATED) {
-                        thread_t* prev = current;
-                        current = threads[idx];
-                        current->state = THREAD_RUNNING;
-                        if (prev->state != THREAD_SLEEPING && prev->state != THREAD_TERMINATED) {
-                                prev->state = THREAD_READY;
-                        }
-                        //qemu_debug_printf("thread_schedule: switching from tid=%d to tid=%d\n", prev->tid, current->tid);
-                        //qemu_debug_printf("thread_schedule: prev.ctx.rflags=0x%x new.ctx.rflags=0x%x\n", (unsigned int)prev->context.rflags, (unsigned int)current->context.rflags);
-                        context_switch(&prev->context, &current->context);
-                        return;
-                }
-        }
-        current = &main_thread;
-        current->state = THREAD_RUNNING;
+void thread_unblock(int pid) {
+        unsigned long flags = irq_save();
+        thread_t* t = thread_find(pid);
+        if (t && t->state == THREAD_BLOCKED) make_ready(t);
+        irq_restore(flags);
 }
 
-void thread_unblock(int pid) {
-        for (int i = 0; i < thread_count; ++i) {
-                if (threads[i] && threads[i]->tid == pid && threads[i]->state == THREAD_BLOCKED) {
-                        threads[i]->state = THREAD_READY;
-                        return;
+int thread_set_priority(int pid, int prio) {
+        if (prio < 0 || prio >= THREAD_PRIO_LEVELS) return -1;
+        unsigned long flags = irq_save();
+        thread_t* t = thread_find(pid);
+        if (t) {
+                t->base_prio = (uint8_t)prio;
+                t->bonus = 0;
+                // стоящий в очереди поток переезжает на новый уровень
+                if (t->state == THREAD_READY) {
+                        rq_remove(t);
+                        rq_push(t);
                 }
         }
+        irq_restore(flags);
+        return t ? 0 : -1;
+}
+
+int thread_get_priority(int pid) {
+        thread_t* t = thread_find(pid);
+        return t ? t->base_prio : -1;
 }
 
 // get thread info by pid
 thread_t* thread_get(int pid) {
-        for (int i = 0; i < thread_count; ++i) {
-                if (threads[i] && threads[i]->tid == pid) {
-                        return threads[i];
-                }
-        }
-        return NULL;
+        return thread_find(pid);
 }
 
+// поток с таким именем и наименьшим tid (порядок в реестре произвольный)
 int thread_get_pid(const char* name) {
+        thread_t* found = NULL;
         for (int i = 0; i < thread_count; ++i) {
-                if (threads[i] && strcmp(threads[i]->name, name) == 0) {
-                        return threads[i]->tid;
-                }
+                thread_t* t = threads[i];
+                if (strcmp(t->name, name) == 0 && (!found || t->tid < found->tid)) found = t;
         }
-        return -1;
+        return found ? (int)found->tid : -1;
 }
 
 int thread_get_state(int pid) {
-        for (int i = 0; i < thread_count; ++i) {
-                if (threads[i] && threads[i]->tid == pid) {
-                        return threads[i]->state;
-                }
-        }
-        return -1;
+        thread_t* t = thread_find(pid);
+        return t ? (int)t->state : -1;
 }
 
 int thread_get_count() {
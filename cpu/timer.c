@@ -0,0 +1,219 @@
+// Колесо крутится в прерывании таймера: xmm прерванного потока трогать нельзя (fpu.h)
+#pragma GCC target("general-regs-only")
+
+#include <timer.h>
+#include <thread.h>
+
+// ---- иерархическое колесо таймеров ----
+// Уровень l хранит таймеры, до срока которых меньше 64^(l+1) мс, в ячейке по
+// битам [6l, 6l+6) срока. Раз в 64^l мс ячейка уровня l «осыпается»: её
+// таймеры перекладываются на уровни ниже, и каждый доходит до уровня 0 как
+// раз к своей миллисекунде.
+
+#define WHEEL_BITS    6
+#define WHEEL_SIZE    (1 << WHEEL_BITS)
+#define WHEEL_MASK    (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS  4
+#define WHEEL_SPAN    (1ULL << (WHEEL_BITS * WHEEL_LEVELS))
+
+static ktimer_t* wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t wheel_clock = 0;        // первая ещё не обработанная миллисекунда
+static size_t wheel_count = 0;          // таймеров в колесе
+static volatile uint64_t now_us = 0;
+static uint64_t last_read_us = 0;       // часы между тиками не должны идти назад
+static int started = 0;
+static const timer_source_t* source = NULL;
+static int nohz = 0;                    // источник в режиме one-shot
+
+static inline unsigned long irq_save(void) {
+        unsigned long flags;
+        __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        return flags;
+}
+
+static inline void irq_restore(unsigned long flags) {
+        __asm__ volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+static void slot_insert(ktimer_t* t) {
+        uint64_t exp = t->expires;
+        if (exp < wheel_clock) exp = wheel_clock;     // просроченный — на ближайший тик
+        uint64_t delta = exp - wheel_clock;
+        int lvl = 0;
+        if (delta >= WHEEL_SPAN) {
+                // слишком далеко: ждёт в последнем уровне и будет переложен позже
+                exp = wheel_clock + WHEEL_SPAN - 1;
+                lvl = WHEEL_LEVELS - 1;
+        } else {
+                while (delta >= (1ULL << (WHEEL_BITS * (lvl + 1)))) lvl++;
+        }
+        ktimer_t** head = &wheel[lvl][(exp >> (WHEEL_BITS * lvl)) & WHEEL_MASK];
+        t->prev = NULL;
+        t->next = *head;
+        if (*head) (*head)->prev = t;
+        *head = t;
+        t->slot = head;
+}
+
+static void slot_remove(ktimer_t* t) {
+        if (t->prev) t->prev->next = t->next;
+        else *t->slot = t->next;
+        if (t->next) t->next->prev = t->prev;
+        t->next = t->prev = NULL;
+        t->slot = NULL;
+}
+
+static void cascade(int lvl, int idx) {
+        ktimer_t* t = wheel[lvl][idx];
+        wheel[lvl][idx] = NULL;
+        while (t) {
+                ktimer_t* n = t->next;
+                slot_insert(t);
+                t = n;
+        }
+}
+
+// Обработать миллисекунду wheel_clock
+static void wheel_run(void) {
+        uint64_t c = wheel_clock;
+        for (int lvl = 1; lvl < WHEEL_LEVELS; lvl++) {
+                if (c & ((1ULL << (WHEEL_BITS * lvl)) - 1)) break;
+                cascade(lvl, (int)((c >> (WHEEL_BITS * lvl)) & WHEEL_MASK));
+        }
+        ktimer_t* t = wheel[0][c & WHEEL_MASK];
+        wheel[0][c & WHEEL_MASK] = NULL;
+        // таймер, заведённый из обработчика на «сейчас», попадёт уже в следующий тик
+        wheel_clock = c + 1;
+        while (t) {
+                ktimer_t* n = t->next;
+                t->next = t->prev = NULL;
+                t->slot = NULL;
+                wheel_count--;
+                t->fn(t->arg);
+                t = n;
+        }
+}
+
+void timer_start(const timer_source_t* src) {
+        source = src;
+        wheel_clock = now_us / 1000;
+        started = 1;
+}
+
+int timer_running(void) {
+        return started;
+}
+
+static void advance(uint32_t us) {
+        now_us += us;
+        uint64_t now = now_us / 1000;
+        // пустое колесо: догонять нечего
+        if (!wheel_count) {
+                if (wheel_clock <= now) wheel_clock = now + 1;
+                return;
+        }
+        while (wheel_clock <= now) wheel_run();
+}
+
+void timer_tick(uint32_t us) {
+        if (!started) return;
+        // прерывание от one-shot: источник уже вернулся к периодическому тику
+        nohz = 0;
+        advance(us);
+}
+
+// Ближайшая миллисекунда, в которую колесу есть что делать: срок первого
+// таймера уровня 0 или ближайшее осыпание непустой ячейки верхних уровней
+// (переложенные таймеры могут оказаться раньше). UINT64_MAX — таймеров нет.
+static uint64_t wheel_next_deadline(void) {
+        if (!wheel_count) return UINT64_MAX;
+        uint64_t c = wheel_clock;
+        uint64_t best = UINT64_MAX;
+        for (int k = 0; k < WHEEL_SIZE; k++) {
+                if (wheel[0][(c + k) & WHEEL_MASK]) { best = c + k; break; }
+        }
+        for (int lvl = 1; lvl < WHEEL_LEVELS; lvl++) {
+                int shift = WHEEL_BITS * lvl;
+                // первая граница уровня не раньше c (осыпание в самой c ещё не было)
+                uint64_t t = ((c + (1ULL << shift) - 1) >> shift) << shift;
+                for (int k = 0; k < WHEEL_SIZE && t < best; k++, t += 1ULL << shift) {
+                        if (wheel[lvl][(t >> shift) & WHEEL_MASK]) { best = t; break; }
+                }
+        }
+        return best;
+}
+
+void timer_nohz_enter(void) {
+        if (!started || nohz || !source || !source->oneshot) return;
+        uint64_t now = timer_now_us();
+        uint64_t next = wheel_next_deadline();
+        uint64_t limit = now / 1000 + TIMER_NOHZ_MAX_MS;
+        if (next > limit) next = limit;
+        // до срока меньше двух тиков: выгоды нет
+        if (next * 1000 < now + 2000) return;
+        uint32_t el = source->oneshot((uint32_t)(next * 1000 - now));
+        advance(el);
+        nohz = 1;
+}
+
+void timer_nohz_exit(void) {
+        if (!nohz) return;
+        nohz = 0;
+        advance(source->periodic());
+}
+
+int timer_nohz_active(void) {
+        return nohz;
+}
+
+uint64_t timer_now_us(void) {
+        uint64_t t = now_us;
+        if (source && source->elapsed_us) t += source->elapsed_us();
+        if (t < last_read_us) t = last_read_us;
+        else last_read_us = t;
+        return t;
+}
+
+uint64_t timer_now_ms(void) {
+        return timer_now_us() / 1000;
+}
+
+void timer_add(ktimer_t* t, uint64_t delay_ms, ktimer_fn_t fn, void* arg) {
+        unsigned long flags = irq_save();
+        // one-shot запрограммирован без учёта нового таймера
+        timer_nohz_exit();
+        if (t->slot) {
+                slot_remove(t);
+                wheel_count--;
+        }
+        t->fn = fn;
+        t->arg = arg;
+        t->expires = timer_now_ms() + delay_ms;
+        slot_insert(t);
+        wheel_count++;
+        irq_restore(flags);
+}
+
+int timer_cancel(ktimer_t* t) {
+        unsigned long flags = irq_save();
+        int was = t->slot != NULL;
+        if (was) {
+                slot_remove(t);
+                wheel_count--;
+        }
+        irq_restore(flags);
+        return was;
+}
+
+void timer_sleep_ms(uint32_t ms) {
+        if (ms == 0) return;
+        unsigned long flags;
+        __asm__ volatile("pushfq; pop %0" : "=r"(flags));
+        // блокироваться можно только в потоке и с разрешёнными прерываниями
+        if (started && init && (flags & 0x200)) {
+                thread_sleep(ms);
+                return;
+        }
+        uint64_t until = timer_now_ms() + ms;
+        while (timer_now_ms() < until) __asm__ volatile("pause");
+}
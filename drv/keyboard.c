@@ -1,3 +1,6 @@
+// Обработчик IRQ1 работает поверх прерванного потока — без xmm
+#pragma GCC target("general-regs-only")
+
 #include <keyboard.h>
 #include <idt.h>
 #include <vga.h>
@@ -291,10 +294,16 @@ void ps2_keyboard_init() {
 // Получить символ (блокирующая функция, как в Unix)
 char kgetc() {
         // Блокирующее ожидание: если нет символов, выполняем HLT с включёнными прерываниями
-        // процессор проснётся на аппаратное IRQ (PIT/PS2)
-        while (buffer_count == 0) {
-                asm volatile("sti; hlt" ::: "memory");
+        // процессор проснётся на аппаратное IRQ (PIT/PS2). Проверка и hlt идут с
+        // выключенными прерываниями, иначе нажатие между ними ждало бы следующего тика
+        unsigned long flags;
+        __asm__ volatile("pushfq; pop %0" : "=r"(flags));
+        for (;;) {
+                __asm__ volatile("cli" ::: "memory");
+                if (buffer_count) break;
+                thread_idle();
         }
+        if (flags & 0x200) __asm__ volatile("sti" ::: "memory");
 
         return get_from_buffer();
 }
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <format.h>
 
 static uint8_t parse_color_code(char bg, char fg);
 
@@ -63,56 +64,74 @@ uint32_t vga_write_colorized_xy(uint32_t x, uint32_t y, const char *s, uint8_t d
     return vx;
 }
 
-void	kprint(uint8_t *str)
+#define SCREEN_END (MAX_COLS * MAX_ROWS * 2)
+#define LAST_LINE  (SCREEN_END - MAX_COLS * 2)
+
+/* Moves every row up by one and blanks the last; the hardware cursor is not touched */
+static void scroll_screen(void)
 {
-	while (*str)
-	{
-		kputchar(*str, GRAY_ON_BLACK);
-		str++;
-	}
+	memmove((uint8_t *)VIDEO_ADDRESS, (uint8_t *)(VIDEO_ADDRESS + MAX_COLS * 2), LAST_LINE);
+	for (uint16_t i = 0; i < MAX_COLS; i++)
+		write('\0', WHITE_ON_BLACK, LAST_LINE + i * 2);
 }
 
-void	kputchar(uint8_t character, uint8_t attribute_byte)
+/* Puts one character at 'offset' and returns the offset after it. Only video memory
+   is touched, so a whole string costs one get_cursor/set_cursor pair. */
+static uint16_t console_emit(uint16_t offset, uint8_t character, uint8_t attribute_byte)
 {
-	uint16_t offset;
-
-	offset = get_cursor();
 	if (character == '\n')
 	{
-		if ((offset / 2 / MAX_COLS) == (MAX_ROWS - 1)) 
-			scroll_line();
-		else
-			set_cursor((offset - offset % (MAX_COLS*2)) + MAX_COLS*2);
+		if (offset >= LAST_LINE)
+		{
+			scroll_screen();
+			return LAST_LINE;
+		}
+		return (offset - offset % (MAX_COLS*2)) + MAX_COLS*2;
 	}
-	else if (character == '\t')
+	if (character == '\t')
 	{
 		// move to next tab stop (8 columns)
 		uint16_t col = (uint16_t)((offset / 2) % MAX_COLS);
 		uint16_t spaces = (uint16_t)(8 - (col % 8));
-		for (uint16_t i = 0; i < spaces; i++) {
-			if (offset == (MAX_COLS * MAX_ROWS * 2)) scroll_line();
-			write(' ', attribute_byte, offset);
-			offset += 2;
-		}
-		set_cursor(offset);
+		for (uint16_t i = 0; i < spaces; i++)
+			offset = console_emit(offset, ' ', attribute_byte);
+		return offset;
 	}
-	else if (character == '\b')
-    {
-        set_cursor(get_cursor() - 1);
-        kputchar(' ', attribute_byte);
-        set_cursor(get_cursor() - 2);
-    }
-	else 
+	if (character == '\b')
+	{
+		if (offset >= 2) offset -= 2;
+		write(' ', attribute_byte, offset);
+		return offset;
+	}
+	if (offset >= SCREEN_END)
+	{
+		scroll_screen();
+		offset = LAST_LINE;
+	}
+	write(character, attribute_byte, offset);
+	return offset + 2;
+}
+
+void	kprint(uint8_t *str)
+{
+	uint16_t offset = get_cursor();
+	while (*str)
 	{
-		if (offset == (MAX_COLS * MAX_ROWS * 2)) scroll_line();
-		write(character, attribute_byte, offset);
-		set_cursor(offset+2);
+		offset = console_emit(offset, *str, GRAY_ON_BLACK);
+		str++;
 	}
+	set_cursor(offset);
+}
+
+void	kputchar(uint8_t character, uint8_t attribute_byte)
+{
+	set_cursor(console_emit(get_cursor(), character, attribute_byte));
 }
 
 void kprint_colorized(const char* str)
 {
     uint8_t color = 0x07;
+    uint16_t offset = get_cursor();
     const char* p = str;
     while (*p) {
         // Чтобы исключить чтение за пределы буфера, проверяем доступную длину вперёд
@@ -123,33 +142,15 @@ void kprint_colorized(const char* str)
             p += 6;
             continue;
         }
-        kputchar(*p++, color);
+        offset = console_emit(offset, (uint8_t)*p++, color);
     }
+    set_cursor(offset);
 }
 
 void	scroll_line()
 {
-	uint8_t i = 1;
-	uint16_t last_line;
-
-	while (i < MAX_ROWS)
-	{
-		memcpy(
-			(uint8_t *)(VIDEO_ADDRESS + (MAX_COLS * (i-1) * 2)), /* src */
-			(uint8_t *)(VIDEO_ADDRESS + (MAX_COLS * i * 2)),     /* dst */
-			(MAX_COLS*2)
-		);
-		i++;
-	}
-
-	last_line = (MAX_COLS*MAX_ROWS*2) - MAX_COLS*2;
-	i = 0;
-	while (i < MAX_COLS)
-	{
-		write('\0', WHITE_ON_BLACK, (last_line + i * 2));
-		i++;
-	}
-	set_cursor(last_line);
+	scroll_screen();
+	set_cursor(LAST_LINE);
 }
 
 void	kclear()
@@ -325,186 +326,85 @@ void ftos(double n, char *buf, int precision) {
     buf[i] = '\0';
 }
 
-static void kputn(char ch, int count, uint8_t color)
+/* kprintf output state: the colour survives chunk boundaries, and a colour tag
+   cut by a boundary is held back until the rest of it arrives */
+struct kprintf_state {
+	uint8_t color;
+	size_t ncarry;
+	char carry[6];
+};
+
+/* 1: complete <(bgfg)> tag, 0: too short to tell yet, -1: not a tag */
+static int color_tag_match(const char *p, size_t n)
+{
+	if (p[0] != '<') return -1;
+	if (n >= 2 && p[1] != '(') return -1;
+	if (n >= 3 && p[2] == '\0') return -1;
+	if (n >= 4 && p[3] == '\0') return -1;
+	if (n >= 5 && p[4] != ')') return -1;
+	if (n >= 6) return p[5] == '>' ? 1 : -1;
+	return 0;
+}
+
+static uint16_t kprintf_flush_carry(struct kprintf_state *st, uint16_t offset)
 {
-	for (int i = 0; i < count; i++) kputchar(ch, color);
+	for (size_t i = 0; i < st->ncarry; i++)
+		offset = console_emit(offset, (uint8_t)st->carry[i], st->color);
+	st->ncarry = 0;
+	return offset;
 }
 
-static int utoa_rev(unsigned long long v, unsigned base, int upper, char *out)
+static void kprintf_sink(void *ctx, const char *s, size_t n)
 {
-	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
-	int n = 0;
-	if (v == 0) { out[n++] = '0'; return n; }
-	while (v) { out[n++] = digits[v % base]; v /= base; }
-	return n;
+	struct kprintf_state *st = (struct kprintf_state *)ctx;
+	uint16_t offset = get_cursor();
+	size_t i = 0;
+	while (st->ncarry && i < n)
+	{
+		st->carry[st->ncarry++] = s[i++];
+		int m = color_tag_match(st->carry, st->ncarry);
+		if (m > 0)
+		{
+			st->color = parse_color_code(st->carry[2], st->carry[3]);
+			st->ncarry = 0;
+		}
+		else if (m < 0)
+			offset = kprintf_flush_carry(st, offset);
+	}
+	for (; i < n; i++)
+	{
+		// inline цветовой код <(bgfg)> — два шестнадцатеричных символа
+		if (s[i] == '<')
+		{
+			int m = color_tag_match(s + i, n - i);
+			if (m > 0)
+			{
+				st->color = parse_color_code(s[i + 2], s[i + 3]);
+				i += 5;
+				continue;
+			}
+			if (m == 0)
+			{
+				memcpy(st->carry, s + i, n - i);
+				st->ncarry = n - i;
+				break;
+			}
+		}
+		offset = console_emit(offset, (uint8_t)s[i], st->color);
+	}
+	set_cursor(offset);
 }
 
+/* Formats through the shared engine (libc/format.c); the screen sees whole chunks */
 void kprintf(const char* fmt, ...)
 {
+	struct kprintf_state st = { 0x07, 0, { 0 } }; // светло-серый на чёрном
 	va_list ap;
 	va_start(ap, fmt);
-
-    uint8_t color = 0x07; // светло-серый на чёрном
-    for (const char *p = fmt; *p; ) {
-        // inline цветовой код <(bgfg)> — два шестнадцатеричных символа
-        if (*p == '<' && p[1] == '(' && p[2] && p[3] && p[4] == ')' && p[5] == '>') {
-            color = parse_color_code(p[2], p[3]);
-            p += 6;
-            continue;
-        }
-
-        // support tab character: move to next tab stop (8 columns) like Linux
-        if (*p == '\t') {
-            uint32_t cx = 0, cy = 0;
-            vga_get_cursor(&cx, &cy);
-            uint32_t spaces = 8 - (cx % 8);
-            if (spaces == 0) spaces = 8;
-            kputn(' ', spaces, color);
-            p++; continue;
-        }
-
-		if (*p != '%') { kputchar(*p++, color); continue; }
- 		p++;
-		// flags
- 		int left = 0, plus = 0, space = 0, alt = 0, zero = 0;
- 		for (;;){
- 			if (*p == '-') { left = 1; p++; }
- 			else if (*p == '+') { plus = 1; p++; }
- 			else if (*p == ' ') { space = 1; p++; }
- 			else if (*p == '#') { alt = 1; p++; }
- 			else if (*p == '0') { zero = 1; p++; }
- 			else break;
- 		}
- 		// width
- 		int width = 0;
- 		if (*p == '*') { width = va_arg(ap, int); p++; }
- 		else while (*p >= '0' && *p <= '9') { width = width*10 + (*p++ - '0'); }
- 		// precision
- 		int prec = -1;
- 		if (*p == '.') {
- 			p++;
- 			if (*p == '*') { prec = va_arg(ap, int); p++; }
- 			else { prec = 0; while (*p >= '0' && *p <= '9') prec = prec*10 + (*p++ - '0'); }
- 		}
- 		// совместимость с нестандартным %10-4x (ширина-точность)
- 		if (prec < 0 && *p == '-') {
- 			p++;
- 			prec = 0; while (*p >= '0' && *p <= '9') prec = prec*10 + (*p++ - '0');
- 		}
- 		// length (минимальный набор)
- 		enum { LEN_DEF, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_Z } len = LEN_DEF;
- 		if (*p == 'h') { p++; if (*p == 'h') { len = LEN_HH; p++; } else len = LEN_H; }
- 		else if (*p == 'l') { p++; if (*p == 'l') { len = LEN_LL; p++; } else len = LEN_L; }
- 		else if (*p == 'z') { len = LEN_Z; p++; }
-
- 		char spec = *p ? *p++ : '\0';
- 		char tmp[64];
- 		int tmplen = 0;
- 		int negative = 0;
- 		char signch = 0;
-
- 		switch (spec) {
- 		case 'c': {
- 			int ch = va_arg(ap, int);
- 			int pad = (width > 1) ? width - 1 : 0;
- 			if (!left) kputn(' ', pad, color);
- 			kputchar((char)ch, color);
- 			if (left) kputn(' ', pad, color);
- 			break; }
-
- 		case 's': {
- 			const char *s = va_arg(ap, const char*);
- 			if (!s) s = "(null)";
- 			int slen = 0; while (s[slen]) slen++;
- 			if (prec >= 0 && prec < slen) slen = prec;
- 			int pad = (width > slen) ? width - slen : 0;
- 			if (!left) kputn(' ', pad, color);
- 			for (int i = 0; i < slen; i++) kputchar(s[i], color);
- 			if (left) kputn(' ', pad, color);
- 			break; }
-
- 		case 'd': case 'i': {
- 			long long v;
- 			if (len == LEN_LL) v = va_arg(ap, long long);
- 			else if (len == LEN_L) v = va_arg(ap, long);
- 			else v = va_arg(ap, int);
- 			unsigned long long u = (v < 0) ? (unsigned long long)(-v) : (unsigned long long)v;
- 			negative = (v < 0);
- 			tmplen = utoa_rev(u, 10, 0, tmp);
- 			signch = negative ? '-' : (plus ? '+' : (space ? ' ' : 0));
- 			goto PRINT_NUMBER_BASE10;
- 		}
-
- 		case 'u': case 'x': case 'X': case 'o': case 'p': {
- 			unsigned base = 10; int upper = 0;
- 			unsigned long long u;
- 			if (spec == 'p') { u = (unsigned long long)(uintptr_t)va_arg(ap, void*); base = 16; alt = 1; }
- 			else {
- 				if (len == LEN_LL) u = va_arg(ap, unsigned long long);
- 				else if (len == LEN_L) u = va_arg(ap, unsigned long);
- 				else if (len == LEN_Z) u = va_arg(ap, size_t);
- 				else u = va_arg(ap, unsigned int);
- 				if (spec == 'x' || spec == 'X') { base = 16; upper = (spec == 'X'); }
- 				else if (spec == 'o') { base = 8; }
- 			}
- 			tmplen = utoa_rev(u, base, upper, tmp);
- 			signch = 0;
-
- 			// точность для целых
- 			int num_digits = tmplen;
- 			int prec_zeros = 0;
- 			if (prec >= 0) {
- 				zero = 0; // при точности флаг 0 игнорируется
- 				if (prec > num_digits) prec_zeros = prec - num_digits;
- 			}
-
- 			// префиксы
- 			char prefix[2]; int plen = 0;
- 			if (alt && base == 16 && u != 0) { prefix[0] = '0'; prefix[1] = (upper ? 'X' : 'x'); plen = 2; }
- 			else if (alt && base == 8 && (u != 0 || prec == 0)) { prefix[0] = '0'; plen = 1; }
-
- 			int field_len = plen + prec_zeros + num_digits;
- 			int pad = (width > field_len) ? width - field_len : 0;
- 			char padch = (zero && !left) ? '0' : ' ';
-
- 			if (!left && padch == ' ') kputn(' ', pad, color);
- 			// вывод префикса/нулями заполнение
- 			if (!left && padch == '0') kputn('0', pad, color);
- 			if (plen) { for (int i = 0; i < plen; i++) kputchar(prefix[i], color); }
- 			kputn('0', prec_zeros, color);
- 			for (int i = num_digits - 1; i >= 0; i--) kputchar(tmp[i], color);
- 			if (left) kputn(' ', pad, color);
- 			break; }
-
- 		case '%':
- 			kputchar('%', color);
- 			break;
-
- 		default:
- 			kputchar(spec, color);
- 			break;
-
-PRINT_NUMBER_BASE10:
- 		{
- 			int num_digits = tmplen;
- 			int prec_zeros = 0;
- 			if (prec >= 0) { zero = 0; if (prec > num_digits) prec_zeros = prec - num_digits; }
- 			int sign_len = signch ? 1 : 0;
- 			int field_len = sign_len + prec_zeros + num_digits;
- 			int pad = (width > field_len) ? width - field_len : 0;
- 			char padch = (zero && !left) ? '0' : ' ';
- 			if (!left && padch == ' ' ) kputn(' ', pad, color);
- 			if (signch) kputchar(signch, color);
- 			if (!left && padch == '0') kputn('0', pad, color);
- 			kputn('0', prec_zeros, color);
- 			for (int i = num_digits - 1; i >= 0; i--) kputchar(tmp[i], color);
- 			if (left) kputn(' ', pad, color);
- 			break;
- 		}
- 		}
- 	}
-
+	fmt_vformat(kprintf_sink, &st, fmt, ap);
 	va_end(ap);
+	// незавершённый тег в самом конце выводится как обычный текст
+	if (st.ncarry) set_cursor(kprintf_flush_carry(&st, get_cursor()));
 }
 
 void vga_set_cursor(uint32_t x, uint32_t y)
@@ -531,63 +431,3 @@ void draw_cell(uint8_t x, uint8_t y, uint8_t ch, uint8_t color) {
 void draw_text(uint8_t x, uint8_t y, const char* s, uint8_t color) {
     for (uint8_t i = 0; s[i]; i++) draw_cell(x + i, y, (uint8_t)s[i], color);
 }
-
-// ---- minimal printf-to-buffer (vsnprintf/snprintf/sprintf) ----
-typedef struct { char* buf; size_t cap; size_t len; } __bufw;
-static void __bw_putc(__bufw* w, char ch) {
-	if (w->len + 1 < w->cap) w->buf[w->len] = ch;
-	w->len++;
-}
-
-static char tmp[64];
-
-static int __vsnprintf(char* out, size_t outsz, const char* fmt, va_list ap_in) {
-	if (!out || outsz==0) return 0;
-	__bufw W = { .buf = out, .cap = outsz, .len = 0 };
-	va_list ap; va_copy(ap, ap_in);
-	for (const char *p = fmt; *p; ) {
-		if (*p != '%') { __bw_putc(&W, *p++); continue; }
-		p++;
-		// flags (ignored mostly)
-		while (*p=='-'||*p=='+'||*p==' '||*p=='#'||*p=='0') p++;
-		// width
-		if (*p=='*') { (void)va_arg(ap,int); p++; } else { while (*p>='0'&&*p<='9') p++; }
-		// precision
-		if (*p=='.') { p++; if (*p=='*'){ (void)va_arg(ap,int); p++; } else { while (*p>='0'&&*p<='9') p++; } }
-		// length
-		if (*p=='h'||*p=='l'||*p=='z') { if ((p[0]=='h'&&p[1]=='h')||(p[0]=='l'&&p[1]=='l')) p+=2; else p++; }
-		char spec = *p ? *p++ : '\0'; int n=0;
-		switch (spec) {
-			case 'c': { int ch=va_arg(ap,int); __bw_putc(&W,(char)ch); break; }
-			case 's': { const char* s=va_arg(ap,const char*); if(!s)s="(null)"; while(*s) __bw_putc(&W,*s++); break; }
-			case 'd': case 'i': {
-				long long v = va_arg(ap,int);
-				unsigned long long u = (v<0)?(unsigned long long)(-v):(unsigned long long)v;
-				if (u==0) tmp[n++]='0';
-				while(u){ tmp[n++]=(char)('0'+(u%10)); u/=10; }
-				if (v<0) __bw_putc(&W,'-');
-				for (int i=n-1;i>=0;i--) __bw_putc(&W,tmp[i]);
-				break;
-			}
-			case 'u': case 'x': case 'X': {
-				unsigned base = (spec=='u')?10:16; int upper = (spec=='X');
-				unsigned long long u = va_arg(ap,unsigned int);
-				const char* D = upper?"0123456789ABCDEF":"0123456789abcdef";
-				if (u==0) tmp[n++]='0';
-				while(u){ tmp[n++]=D[u%base]; u/=base; }
-				for (int i=n-1;i>=0;i--) __bw_putc(&W,tmp[i]);
-				break;
-			}
-			case '%': __bw_putc(&W,'%'); break;
-			default: __bw_putc(&W,spec); break;
-		}
-	}
-	// NUL
-	if (W.len < W.cap) W.buf[W.len] = '\0'; else W.buf[W.cap-1] = '\0';
-	va_end(ap);
-	return (int)W.len;
-}
-
-int vsnprintf(char* out, size_t outsz, const char* fmt, va_list ap) { return __vsnprintf(out, outsz, fmt, ap); }
-int snprintf(char* out, size_t outsz, const char* fmt, ...) { va_list ap; va_start(ap, fmt); int r=__vsnprintf(out,outsz,fmt,ap); va_end(ap); return r; }
-int sprintf(char* out, const char* fmt, ...) { va_list ap; va_start(ap, fmt); int r=__vsnprintf(out,(size_t)-1,fmt,ap); va_end(ap); return r; }
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include "../inc/heap.h"
 #include "../inc/ext2.h"
 #include "../inc/fs.h"
+#include "../inc/vm.h"
+#include "../inc/paging.h"
 
 /* Minimal ext2 runtime structures */
 struct ext2_mount {
@@ -133,6 +135,22 @@ found_inode: ;
     return 0;
 }
 
+/* Image block holding logical block idx of the file, 0 if none (holes and
+   double/triple indirect blocks are not supported) */
+static uint32_t ext2_file_block(struct ext2_inode *inode, uint32_t idx) {
+    uint32_t ptrs_per_block = g_mount->block_size / 4;
+    if (idx < 12) return inode->i_block[idx];
+    if (idx < 12 + ptrs_per_block) {
+        /* single indirect */
+        uint32_t indirect_block = inode->i_block[12];
+        if (indirect_block == 0) return 0;
+        uint32_t *arr = (uint32_t*)ext2_block_ptr(g_mount, indirect_block);
+        if (!arr) return 0;
+        return arr[idx - 12];
+    }
+    return 0;
+}
+
 static ssize_t ext2_read(struct fs_file *file, void *buf, size_t size, size_t offset) {
     if (!file || !file->driver_private || !g_mount) return -1;
     struct ext2_file_handle *fh = (struct ext2_file_handle*)file->driver_private;
@@ -144,24 +162,8 @@ static ssize_t ext2_read(struct fs_file *file, void *buf, size_t size, size_t of
     uint32_t block_size = g_mount->block_size;
     uint32_t first_block = offset / block_size;
     uint32_t block_offset = offset % block_size;
-    uint32_t ptrs_per_block = block_size / 4;
     while (to_read > 0) {
-        uint32_t block_no = 0;
-        if (first_block < 12) {
-            block_no = inode->i_block[first_block];
-        } else if (first_block < 12 + ptrs_per_block) {
-            /* single indirect */
-            uint32_t indirect_block = inode->i_block[12];
-            if (indirect_block == 0) return read;
-            uint8_t *ind_blk = ext2_block_ptr(g_mount, indirect_block);
-            if (!ind_blk) return read;
-            uint32_t idx = first_block - 12;
-            uint32_t *arr = (uint32_t*)ind_blk;
-            block_no = arr[idx];
-        } else {
-            /* double/triple indirect not supported */
-            return read;
-        }
+        uint32_t block_no = ext2_file_block(inode, first_block);
         if (block_no == 0) return read;
         uint8_t *blk = ext2_block_ptr(g_mount, block_no);
         if (!blk) return read;
@@ -176,6 +178,56 @@ static ssize_t ext2_read(struct fs_file *file, void *buf, size_t size, size_t of
     return (ssize_t)read;
 }
 
+/* The image stays in memory, so a view never copies: a range whose blocks are
+   consecutive in the image is returned as a pointer into it; otherwise, with
+   page-sized (or larger) page-aligned blocks, the blocks' frames are mapped
+   back to back into a fresh virtual range. */
+static int ext2_mmap(struct fs_file *file, size_t offset, size_t size, struct fs_map *map) {
+    if (!file || !file->driver_private || !g_mount) return -1;
+    struct ext2_inode *inode = &((struct ext2_file_handle*)file->driver_private)->inode;
+    if (offset >= inode->i_size) return -1;
+    if (size > inode->i_size - offset) size = inode->i_size - offset;
+    uint32_t block_size = g_mount->block_size;
+    uint32_t first = offset / block_size;
+    uint32_t last = (offset + size - 1) / block_size;
+    uint32_t start_no = ext2_file_block(inode, first);
+    if (start_no == 0) return -1;
+    int contiguous = 1;
+    for (uint32_t b = first + 1; b <= last; b++) {
+        uint32_t no = ext2_file_block(inode, b);
+        if (no == 0) return -1;
+        if (no != start_no + (b - first)) contiguous = 0;
+    }
+    if (contiguous) {
+        uint8_t *blk = ext2_block_ptr(g_mount, start_no);
+        if (!blk || (uint64_t)(start_no + (last - first) + 1) * block_size > g_mount->size) return -1;
+        map->addr = blk + offset % block_size;
+        map->len = size;
+        map->kind = FS_MAP_DIRECT;
+        map->base = NULL;
+        return 0;
+    }
+    if (block_size % VM_PAGE_SIZE || ((uintptr_t)g_mount->image & (VM_PAGE_SIZE - 1))) return -1;
+    size_t per_block = block_size / VM_PAGE_SIZE;
+    size_t count = (size_t)(last - first + 1) * per_block;
+    uint64_t *frames = (uint64_t*)kmalloc(count * sizeof(uint64_t));
+    if (!frames) return -1;
+    for (uint32_t b = first; b <= last; b++) {
+        uint8_t *blk = ext2_block_ptr(g_mount, ext2_file_block(inode, b));
+        if (!blk) { kfree(frames); return -1; }
+        for (size_t p = 0; p < per_block; p++)
+            frames[(b - first) * per_block + p] = virt_to_phys((uint64_t)(uintptr_t)(blk + p * VM_PAGE_SIZE));
+    }
+    uint8_t *va = (uint8_t*)vm_map_frames(frames, count, 0);
+    kfree(frames);
+    if (!va) return -1;
+    map->addr = va + offset % block_size;
+    map->len = size;
+    map->kind = FS_MAP_PAGES;
+    map->base = va;
+    return 0;
+}
+
 static void ext2_release(struct fs_file *file) {
     if (!file) return;
     if (file->driver_private) kfree(file->driver_private);
@@ -191,6 +243,7 @@ int ext2_register(void) {
     ext2_ops.read = ext2_read;
     ext2_ops.write = NULL;
     ext2_ops.release = ext2_release;
+    ext2_ops.mmap = ext2_mmap;
     ext2_driver.ops = &ext2_ops;
     ext2_driver.driver_data = (void*)g_mount;
     return fs_register_driver(&ext2_driver);
@@ -6,6 +6,8 @@
 /* driver-specific stat helpers */
 #include "../inc/sysfs.h"
 #include "../inc/ramfs.h"
+#include "../inc/heap.h"
+#include "../inc/vm.h"
 
 #define MAX_FS_DRIVERS 8
 #define MAX_FS_MOUNTS 8
@@ -135,6 +137,37 @@ ssize_t fs_write(struct fs_file *file, const void *buf, size_t size, size_t offs
     return -1;
 }
 
+int fs_mmap(struct fs_file *file, size_t offset, size_t size, struct fs_map *map) {
+    if (!file || !file->path || !map) return -1;
+    memset(map, 0, sizeof(*map));
+    if (offset >= file->size) return 0;
+    if (size == 0 || size > file->size - offset) size = file->size - offset;
+    for (int i = 0; i < g_drivers_count; i++) {
+        struct fs_driver *drv = g_drivers[i];
+        if (!drv || !drv->ops || drv->driver_data != file->fs_private) continue;
+        if (drv->ops->mmap && drv->ops->mmap(file, offset, size, map) == 0) return 0;
+        break;
+    }
+    /* no shared backing: hand out a private copy */
+    char *copy = (char*)kmalloc(size + 1);
+    if (!copy) return -1;
+    ssize_t r = fs_read(file, copy, size, offset);
+    if (r < 0) { kfree(copy); return -1; }
+    copy[r] = '\0';
+    map->addr = copy;
+    map->len = (size_t)r;
+    map->kind = FS_MAP_COPY;
+    map->base = copy;
+    return 0;
+}
+
+void fs_munmap(struct fs_map *map) {
+    if (!map) return;
+    if (map->kind == FS_MAP_COPY && map->base) kfree(map->base);
+    else if (map->kind == FS_MAP_PAGES && map->base) vm_release(map->base);
+    memset(map, 0, sizeof(*map));
+}
+
 void fs_file_free(struct fs_file *file) {
     if (!file) return;
     /* let driver release internal resources if provided */
@@ -5,6 +5,8 @@
 #include "../inc/ext2.h"
 #include "../inc/ramfs.h"
 #include "../inc/heap.h"
+#include "../inc/vm.h"
+#include "../inc/paging.h"
 #include "../inc/stat.h"
 #include "../inc/thread.h"
 
@@ -53,55 +55,47 @@ static struct ramfs_node *ramfs_alloc_node(const char *name, int is_dir) {
     return n;
 }
 
-static struct ramfs_node *ramfs_find_child(struct ramfs_node *parent, const char *name) {
+static struct ramfs_node *ramfs_find_child_n(struct ramfs_node *parent, const char *name, size_t len) {
     if (!parent || !parent->children) return NULL;
     struct ramfs_node *c = parent->children;
     while (c) {
-        if (strcmp(c->name, name) == 0) return c;
+        if (strncmp(c->name, name, len) == 0 && c->name[len] == '\0') return c;
         c = c->next;
     }
     return NULL;
 }
 
-static struct ramfs_node *ramfs_lookup(const char *path) {
-    if (!path) return NULL;
-    if (strcmp(path, "/") == 0) return ramfs_root;
-    if (path[0] != '/') return NULL;
-    char *tmp = (char*)kmalloc(strlen(path)+1);
-    strcpy(tmp, path+1); /* skip leading slash */
+static struct ramfs_node *ramfs_find_child(struct ramfs_node *parent, const char *name) {
+    return ramfs_find_child_n(parent, name, strlen(name));
+}
+
+/* walks the first 'len' bytes of an absolute path without copying it */
+static struct ramfs_node *ramfs_lookup_n(const char *path, size_t len) {
+    if (!path || len == 0 || path[0] != '/') return NULL;
     struct ramfs_node *cur = ramfs_root;
-    char *tok = strtok(tmp, "/");
-    while (tok && cur) {
-        cur = ramfs_find_child(cur, tok);
-        tok = strtok(NULL, "/");
-    }
-    kfree(tmp);
+    str_iter_t it;
+    str_span_t seg;
+    str_iter_init_n(&it, path, len, "/");
+    while (cur && str_iter_next(&it, &seg))
+        cur = ramfs_find_child_n(cur, seg.ptr, seg.len);
     return cur;
 }
 
+static struct ramfs_node *ramfs_lookup(const char *path) {
+    return path ? ramfs_lookup_n(path, strlen(path)) : NULL;
+}
+
 static int ramfs_create(const char *path, struct fs_file **out_file) {
     if (!path || path[0] != '/') return -1;
-    /* find parent */
-    char *tmp = (char*)kmalloc(strlen(path)+1);
-    strcpy(tmp, path);
-    char *slash = strrchr(tmp, '/');
-    char *name = NULL;
-    char parent_path[256];
-    if (slash == tmp) {
-        /* parent is root */
-        strcpy(parent_path, "/");
-        name = slash + 1;
-    } else {
-        *slash = '\0';
-        strcpy(parent_path, tmp);
-        name = slash + 1;
-    }
-    struct ramfs_node *parent = ramfs_lookup(parent_path);
-    if (!parent) { kfree(tmp); return -2; }
-    if (!parent->is_dir) { kfree(tmp); return -3; }
-    if (ramfs_find_child(parent, name)) { kfree(tmp); return -4; }
+    /* find parent: everything before the last slash ("/" for top-level names) */
+    const char *slash = strrchr(path, '/');
+    const char *name = slash + 1;
+    struct ramfs_node *parent = ramfs_lookup_n(path, slash == path ? 1 : (size_t)(slash - path));
+    if (!parent) return -2;
+    if (!parent->is_dir) return -3;
+    if (ramfs_find_child(parent, name)) return -4;
     struct ramfs_node *n = ramfs_alloc_node(name, 0);
-    if (!n) { kfree(tmp); return -5; }
+    if (!n) return -5;
     /* set owner to current thread euid/egid */
     thread_t* ct = thread_current();
     if (ct) { n->uid = ct->euid; n->gid = ct->egid; }
@@ -123,7 +117,6 @@ static int ramfs_create(const char *path, struct fs_file **out_file) {
     fh->node = n;
     f->driver_private = fh;
     if (out_file) *out_file = f;
-    kfree(tmp);
     return 0;
 }
 
@@ -146,6 +139,19 @@ static int ramfs_open(const char *path, struct fs_file **out_file) {
     return 0;
 }
 
+/* Regular files are one contiguous buffer, so a view is just a pointer into it */
+static int ramfs_mmap(struct fs_file *file, size_t offset, size_t size, struct fs_map *map) {
+    if (!file || !file->driver_private) return -1;
+    struct ramfs_node *n = ((struct ramfs_file_handle*)file->driver_private)->node;
+    if (!n || n->is_dir || !n->data || offset >= n->size) return -1;
+    if (size > n->size - offset) size = n->size - offset;
+    map->addr = n->data + offset;
+    map->len = size;
+    map->kind = FS_MAP_DIRECT;
+    map->base = NULL;
+    return 0;
+}
+
 static ssize_t ramfs_read(struct fs_file *file, void *buf, size_t size, size_t offset) {
     if (!file || !file->driver_private) return -1;
     struct ramfs_file_handle *fh = (struct ramfs_file_handle*)file->driver_private;
@@ -215,6 +221,66 @@ int ramfs_fill_stat(struct fs_file *file, struct stat *st) {
     return 0;
 }
 
+/* Files that grow past RAMFS_LAZY_MIN move to demand-zero memory: only the pages
+   actually written get frames, so a write at a high offset leaves a cheap hole. */
+#define RAMFS_LAZY_MIN (256u * 1024u)
+
+static void ramfs_free_data(struct ramfs_node *n) {
+    if (!n->data) return;
+    if (vm_owns(n->data)) vm_release(n->data);
+    else kfree(n->data);
+    n->data = NULL;
+}
+
+/* copy file contents page by page, skipping pages of a lazy region never touched */
+static void ramfs_copy_data(char *dst, const char *src, size_t len) {
+    int sparse = vm_owns(src);
+    for (size_t off = 0; off < len; off += VM_PAGE_SIZE) {
+        size_t chunk = len - off < VM_PAGE_SIZE ? len - off : VM_PAGE_SIZE;
+        if (sparse && !virt_to_phys((uint64_t)(uintptr_t)(src + off))) continue;
+        memcpy(dst + off, src + off, chunk);
+    }
+}
+
+/* plain heap buffer; also the fallback when no vm region is left */
+static int ramfs_grow_heap(struct ramfs_node *n, size_t new_size) {
+    if (n->data && vm_owns(n->data)) {
+        /* a region cannot be krealloc'ed: copy out, untouched pages read as zero */
+        char *d = (char*)kmalloc(new_size);
+        if (!d) return -1;
+        memset(d, 0, new_size);
+        ramfs_copy_data(d, n->data, n->size);
+        ramfs_free_data(n);
+        n->data = d;
+        n->size = new_size;
+        return 0;
+    }
+    char *d = (char*)krealloc(n->data, new_size);
+    if (!d) return -1;
+    /* a write past the end must not expose stale heap bytes */
+    memset(d + n->size, 0, new_size - n->size);
+    n->data = d;
+    n->size = new_size;
+    return 0;
+}
+
+static int ramfs_grow(struct ramfs_node *n, size_t new_size) {
+    if (n->data && vm_owns(n->data) && new_size <= vm_region_size(n->data)) {
+        n->size = new_size;
+        return 0;
+    }
+    if (new_size < RAMFS_LAZY_MIN) return ramfs_grow_heap(n, new_size);
+    /* reserve with headroom: address space is cheap, untouched pages cost nothing */
+    char *d = (char*)vm_reserve(new_size * 2, 0);
+    /* the region table is small and shared with fs_mmap views */
+    if (!d) return ramfs_grow_heap(n, new_size);
+    if (n->data) ramfs_copy_data(d, n->data, n->size);
+    ramfs_free_data(n);
+    n->data = d;
+    n->size = new_size;
+    return 0;
+}
+
 static ssize_t ramfs_write(struct fs_file *file, const void *buf, size_t size, size_t offset) {
     if (!file || !file->driver_private) return -1;
     struct ramfs_file_handle *fh = (struct ramfs_file_handle*)file->driver_private;
@@ -224,12 +290,7 @@ static ssize_t ramfs_write(struct fs_file *file, const void *buf, size_t size, s
     thread_t* ct = thread_current();
     if (!ct || ct->euid != 0) return -1;
     size_t new_size = offset + size;
-    if (new_size > n->size) {
-        char *d = (char*)krealloc(n->data, new_size);
-        if (!d) return -1;
-        n->data = d;
-        n->size = new_size;
-    }
+    if (new_size > n->size && ramfs_grow(n, new_size) != 0) return -1;
     memcpy(n->data + offset, buf, size);
     return (ssize_t)size;
 }
@@ -252,11 +313,8 @@ int ramfs_mkdir(const char *path) {
     if (l > 1 && tmp[l-1] == '/') tmp[l-1] = '\0';
     /* find parent */
     char *slash = strrchr(tmp, '/');
-    char parent_path[256];
-    char *name;
-    if (slash == tmp) { strcpy(parent_path, "/"); name = slash + 1; }
-    else { *slash = '\0'; strcpy(parent_path, tmp); name = slash + 1; }
-    struct ramfs_node *parent = ramfs_lookup(parent_path);
+    char *name = slash + 1;
+    struct ramfs_node *parent = ramfs_lookup_n(tmp, slash == tmp ? 1 : (size_t)(slash - tmp));
     if (!parent) { kfree(tmp); return -2; }
     if (!parent->is_dir) { kfree(tmp); return -3; }
     if (ramfs_find_child(parent, name)) { kfree(tmp); return -4; }
@@ -294,7 +352,7 @@ int ramfs_remove(const char *path) {
             if (sp < 64) stack[sp++] = c;
         }
         if (cur->name) kfree(cur->name);
-        if (cur->data) kfree(cur->data);
+        ramfs_free_data(cur);
         kfree(cur);
     }
     return 0;
@@ -315,6 +373,7 @@ int ramfs_register(void) {
     ramfs_ops.write = ramfs_write;
     ramfs_ops.chmod = ramfs_chmod;
     ramfs_ops.release = ramfs_release;
+    ramfs_ops.mmap = ramfs_mmap;
 
     return fs_register_driver(&ramfs_driver);
 }
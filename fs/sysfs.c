@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stddef.h>
+#include <stdarg.h>
 #include <string.h>
 #include "../inc/fs.h"
 #include "../inc/sysfs.h"
@@ -7,6 +8,7 @@
 #include "../inc/ext2.h"
 #include "../inc/stat.h"
 #include "../inc/spinlock.h"
+#include "../inc/format.h"
 #include "../inc/rtc.h"
 #include "../inc/thread.h"
 #include "../inc/stdint.h"
@@ -244,6 +246,8 @@ static int sysfs_open(const char *path, struct fs_file **out_file) {
     f->path = pp;
     f->fs_private = sysfs_driver.driver_data;
     f->type = node->is_dir ? FS_TYPE_DIR : FS_TYPE_REG;
+    /* values of dynamic attributes (counters, stats) change between opens */
+    if (!node->is_dir) sysfs_update_node_size(node);
     f->size = node->size;
     struct sysfs_handle *h = (struct sysfs_handle*)kmalloc(sizeof(struct sysfs_handle));
     if (!h) { kfree((void*)f->path); kfree(f); return -1; }
@@ -464,6 +468,36 @@ int sysfs_remove(const char *path) {
     return 0;
 }
 
+size_t sysfs_emit_at(char *buf, size_t size, size_t pos, const char *fmt, ...) {
+    if (!buf || pos >= size) return pos;
+    /* format into a scratch line first: vsnprintf reserves the last byte for NUL,
+       but show() buffers are sized exactly to the content (see bi_cat) */
+    char line[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n <= 0) return pos;
+    size_t len = (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1;
+    if (len > size - pos) len = size - pos;
+    memcpy(buf + pos, line, len);
+    return pos + len;
+}
+
+int sysfs_parse_ulong(const char *buf, size_t size, unsigned long *out) {
+    size_t i = 0;
+    unsigned long v = 0;
+    if (!buf || !out) return -1;
+    while (i < size && (buf[i] == ' ' || buf[i] == '\t')) i++;
+    if (i >= size || buf[i] < '0' || buf[i] > '9') return -1;
+    for (; i < size && buf[i] >= '0' && buf[i] <= '9'; i++) v = v * 10 + (unsigned long)(buf[i] - '0');
+    /* allow a trailing newline from "echo N > file" */
+    while (i < size && (buf[i] == ' ' || buf[i] == '\n' || buf[i] == '\r' || buf[i] == '\0')) i++;
+    if (i != size) return -1;
+    *out = v;
+    return 0;
+}
+
 int sysfs_chmod(const char *path, mode_t mode) {
     if (!sysfs_root || !path) return -1;
     if (!(strcmp(path, "/sys") == 0 || strncmp(path, "/sys/", 5) == 0)) return -1;
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-callsite kmalloc profiler. Only active in kernels built with
+// `make KMALLOC_PROFILE=1` (defines CONFIG_KMALLOC_PROFILE); otherwise the hooks
+// compile to nothing and the reporting functions say that profiling is off.
+
+#define ALLOCPROF_BUCKETS 8     // size histogram: <=16, 64, 256, 1K, 4K, 16K, 64K, larger
+
+enum allocprof_sort {
+    ALLOCPROF_SORT_LIVE = 0,    // live bytes (default)
+    ALLOCPROF_SORT_COUNT,       // number of allocations
+    ALLOCPROF_SORT_BYTES,       // total bytes ever allocated
+    ALLOCPROF_SORT_RATE,        // allocations per second
+};
+
+#ifdef CONFIG_KMALLOC_PROFILE
+void allocprof_alloc(void* site, void* ptr, size_t size);
+void allocprof_free(void* ptr);
+#define ALLOCPROF_ALLOC(ptr, size) allocprof_alloc(__builtin_return_address(0), (ptr), (size))
+#define ALLOCPROF_FREE(ptr)        allocprof_free(ptr)
+#else
+#define ALLOCPROF_ALLOC(ptr, size) ((void)0)
+#define ALLOCPROF_FREE(ptr)        ((void)0)
+#endif
+
+// Format the site table (at most 'max_rows' rows) sorted by 'key' into buf.
+size_t allocprof_format(char* buf, size_t size, int key, int max_rows);
+
+// Parse "live", "count", "bytes" or "rate"; -1 if unknown.
+int    allocprof_parse_key(const char* s, size_t len);
+
+void   allocprof_reset(void);
+
+// Creates /sys/kernel/mm/alloc_sites (write a sort key to change the order,
+// "reset" to clear the counters)
+void   allocprof_sysfs_init(void);
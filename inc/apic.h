@@ -7,6 +7,7 @@
 #define LAPIC_ID_REG          0x020
 #define LAPIC_VERSION_REG     0x030
 #define LAPIC_EOI_REG         0x0B0
+#define LAPIC_IRR_REG         0x200  // 8 registers, 16 bytes apart, 32 vectors each
 #define LAPIC_SVR_REG         0x0F0
 #define LAPIC_LVT_TIMER_REG   0x320
 #define LAPIC_TIMER_INIT_REG  0x380
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <timer.h>
 
 #define APIC_TIMER_VECTOR     0x30
 
@@ -48,6 +49,9 @@ void apic_timer_sleep_us(uint32_t us);
 uint64_t apic_timer_get_uptime_seconds(void);
 void apic_timer_format_uptime(char* buffer, size_t buffer_size);
 
+// Kernel clock source: periodic tick with one-shot NO_HZ (see timer.h)
+extern const timer_source_t apic_timer_source;
+
 // Global state
 extern volatile uint64_t apic_timer_ticks;
 extern apic_timer_state_t apic_timer_state;
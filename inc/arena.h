@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Region (bump-pointer) allocator for short-lived temporaries. Objects are never
+// freed one by one: arena_reset drops everything at once, arena_mark/arena_release
+// drop everything allocated after a point (so nested users can share an arena).
+// Memory comes from kmalloc in chunks; the first chunk is kept across resets, so
+// a steady workload stops touching the heap after warm-up.
+// Not thread safe: an arena belongs to one thread.
+
+typedef struct arena_chunk {
+    struct arena_chunk* prev;   // older chunk
+    size_t size;                // usable bytes
+    size_t used;
+} arena_chunk_t;
+
+typedef struct arena {
+    arena_chunk_t* head;        // newest chunk, allocations come from here
+    arena_chunk_t* base;        // first chunk, allocated together with the arena
+    size_t chunk_size;
+    size_t peak;                // most bytes ever live at once
+    size_t live;
+} arena_t;
+
+typedef struct {
+    arena_chunk_t* chunk;
+    size_t used;
+    size_t live;
+} arena_mark_t;
+
+// 'chunk_size' is the default chunk payload; larger requests get a chunk of their own.
+arena_t* arena_create(size_t chunk_size);
+void     arena_destroy(arena_t* a);
+
+// 16-byte aligned, uninitialized; 0 when out of memory.
+void*    arena_alloc(arena_t* a, size_t size);
+
+// Release everything, keeping only the first chunk.
+void     arena_reset(arena_t* a);
+
+arena_mark_t arena_mark(const arena_t* a);
+void     arena_release(arena_t* a, arena_mark_t m);
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, zlib/PNG/Ethernet) and CRC-32C (Castagnoli, iSCSI/ext4/btrfs).
+// Both take the previous result to continue a running checksum: start with 0,
+// then crc = crc32(crc, next_chunk, len).
+// CRC-32C uses the SSE4.2 crc32 instruction when the CPU has it; everything else
+// is slicing-by-8 over tables built on first use (8 KiB per polynomial).
+
+uint32_t crc32(uint32_t crc, const void* buf, size_t len);
+uint32_t crc32c(uint32_t crc, const void* buf, size_t len);
+
+// Name of the CRC-32C implementation in use ("sse4.2" or "slice8")
+const char* crc32c_impl_name(void);
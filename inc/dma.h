@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "paging.h"
+
+// Coherent DMA buffers: physically contiguous, zeroed, naturally aligned to
+// their size class (4 KiB, 64 KiB, or the next power of two up to 2 MiB) and
+// below 4 GiB, so 32-bit capable devices can reach them. The CPU address is the
+// identity mapping of the frames, i.e. the bus address equals the pointer.
+// No thread safety assumed (callers should serialize).
+
+#define DMA_MAX_SIZE      (2ULL * 1024 * 1024)
+
+// Cache attributes (page PCD/PWT bits with the power-on PAT). x86 DMA snoops the
+// caches, so DMA_ATTR_WB is coherent; the others are for buffers a device reads
+// behind the CPU's back in ways that must not be cached (e.g. write-through rings).
+#define DMA_ATTR_WB       0ULL
+#define DMA_ATTR_WT       PG_PWT
+#define DMA_ATTR_UC_MINUS PG_PCD
+#define DMA_ATTR_UC       (PG_PCD | PG_PWT)
+
+// Returns the CPU pointer and stores the bus address in *dma_handle; 0 on failure.
+void*    dma_alloc_coherent(size_t size, uint64_t* dma_handle, uint64_t attrs);
+
+// 'size' must be the size passed to dma_alloc_coherent.
+void     dma_free_coherent(void* cpu_addr, size_t size);
+
+// Physical address behind any mapped kernel pointer (0 if unmapped).
+uint64_t dma_virt_to_phys(const void* va);
+
+// Creates /sys/kernel/mm/dma
+void     dma_sysfs_init(void);
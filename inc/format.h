@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+
+// Shared printf engine. Output is rendered into a stack buffer and handed to
+// the sink in whole chunks (at most FMT_CHUNK bytes, not NUL-terminated), so a
+// sink pays its per-call cost (cursor I/O, locking) once per chunk, not per char.
+//
+// Supported: flags "-+ #0", width and precision (also '*'), lengths hh h l ll z j t,
+// conversions d i u x X o p c s %. The old kprintf form "%10-4x" (width-precision)
+// is still accepted.
+
+#define FMT_CHUNK 256
+
+typedef void (*fmt_sink_t)(void* ctx, const char* s, size_t n);
+
+// Returns the number of characters produced.
+int fmt_vformat(fmt_sink_t sink, void* ctx, const char* fmt, va_list ap);
+int fmt_format(fmt_sink_t sink, void* ctx, const char* fmt, ...);
+
+// C semantics: always NUL-terminated when outsz > 0, returns the untruncated length.
+int vsnprintf(char* out, size_t outsz, const char* fmt, va_list ap);
+int snprintf(char* out, size_t outsz, const char* fmt, ...);
+int sprintf(char* out, const char* fmt, ...);
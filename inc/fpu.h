@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct thread;
+
+// Lazy FPU/SSE/AVX context switching.
+// Each thread owns a save area (XSAVE layout when the CPU has it, FXSAVE
+// otherwise). The registers belong to at most one thread at a time, the
+// "owner"; switching to any other thread sets CR0.TS, and its first FPU/SSE
+// instruction traps with #NM, which saves the owner's state and loads the
+// thread's own. Threads that never touch the FPU never trap and never pay for
+// a save/restore.
+//
+// The scheme relies on code that runs in interrupt or fault context never
+// touching xmm registers behind the trap: those units are compiled with
+// #pragma GCC target("general-regs-only"). Save areas are allocated when the
+// thread is created (creation fails without one), never in the #NM handler.
+
+// Detect XSAVE/XSAVEOPT, enable them, install the #NM handler. Call after thread_init().
+void   fpu_init(void);
+// Save area size in bytes (0 before fpu_init)
+size_t fpu_state_size(void);
+// Allocate a save area for a new thread (NULL before fpu_init or if out of memory)
+void*  fpu_state_alloc(void);
+// A dying thread gives up the registers (its save area goes with the thread_t)
+void   fpu_release(struct thread* t);
+
+// Called by the scheduler right before context_switch(prev -> next)
+void   fpu_switch(struct thread* prev, struct thread* next);
+
+// Kernel code that uses xmm/ymm registers explicitly wraps the use in
+// begin/end: the owner's state is saved first, interrupts stay off in between.
+// Must not nest.
+void   kernel_fpu_begin(unsigned long* flags);
+void   kernel_fpu_end(unsigned long flags);
+
+// "xsaveopt", "xsave" or "fxsave"
+const char* fpu_mode_name(void);
@@ -18,6 +18,21 @@ struct fs_file {
     int type;                 /* FS_TYPE_* (set by driver) */
 };
 
+/* Read-only view of a file range returned by fs_mmap. Depending on the backing
+   it points straight into the file data (FS_MAP_DIRECT), at the file's pages
+   mapped into a fresh virtual range (FS_MAP_PAGES) or at a private copy
+   (FS_MAP_COPY, for drivers that cannot share their storage). */
+struct fs_map {
+    const void *addr;          /* first byte of the requested range */
+    size_t len;                /* bytes available at addr (clamped to the file size) */
+    int kind;                  /* FS_MAP_* */
+    void *base;                /* mapping/copy to release in fs_munmap */
+};
+
+#define FS_MAP_DIRECT   0
+#define FS_MAP_PAGES    1
+#define FS_MAP_COPY     2
+
 /* Filesystem driver operations (minimal set) */
 struct fs_driver_ops {
     const char *name; /* short name of FS (e.g., "ext2") */
@@ -41,6 +56,9 @@ struct fs_driver_ops {
     void (*release)(struct fs_file *file);
     /* Optional chmod operation: set mode for path */
     int (*chmod)(const char *path, mode_t mode);
+    /* Optional: describe [offset, offset+size) of file without copying it.
+       Return 0 and fill map, or -1 to let the VFS fall back to a copy. */
+    int (*mmap)(struct fs_file *file, size_t offset, size_t size, struct fs_map *map);
 };
 
 /* Registered driver object */
@@ -63,6 +81,11 @@ struct fs_file *fs_open(const char *path);
 ssize_t fs_read(struct fs_file *file, void *buf, size_t size, size_t offset);
 ssize_t fs_write(struct fs_file *file, const void *buf, size_t size, size_t offset);
 void fs_file_free(struct fs_file *file);
+/* Map [offset, offset+size) of file for reading; size 0 means up to the end.
+   A direct view stays valid until the file is written or freed.
+   Returns 0 on success (map->len may be 0 at end of file). */
+int fs_mmap(struct fs_file *file, size_t offset, size_t size, struct fs_map *map);
+void fs_munmap(struct fs_map *map);
 /* Read next chunk from directory/file using and advancing file->pos */
 ssize_t fs_readdir_next(struct fs_file *file, void *buf, size_t size);
 
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Open-addressing hash table (Robin Hood probing, backward-shift deletion).
+// Keys are either 64-bit integers or C strings; a string table stores the key
+// pointer, not a copy, so the string must outlive its entry. Values are opaque
+// pointers and must not be NULL (NULL means "not found").
+//
+// Growing is incremental: the old slot array is kept next to the new one and a
+// few of its entries move over on every insert/delete, so no single call pays
+// for rehashing the whole table. Lookups check both arrays until the old one
+// is drained.
+// No thread safety assumed (callers should serialize).
+
+#define HTAB_KEY_U64  0
+#define HTAB_KEY_STR  1
+
+typedef struct {
+    uint64_t key;       // the integer, or the string pointer
+    void*    value;
+    uint32_t hash;
+    uint16_t dist;      // 0: empty, otherwise probe distance + 1
+    uint16_t dead;      // removed from the old array while it drains
+} htab_slot_t;
+
+typedef struct {
+    htab_slot_t* slots;
+    size_t cap;             // power of two
+    size_t used;            // occupied slots in 'slots'
+    htab_slot_t* old;       // array being drained after a resize, or NULL
+    size_t old_cap;
+    size_t old_pos;         // next old slot to move
+    size_t count;           // live keys in both arrays
+    int kind;
+} htab_t;
+
+// 'hint' is the expected number of keys (0 for a small default). 0 on success, -1 if out of memory.
+int   htab_init(htab_t* t, int kind, size_t hint);
+void  htab_destroy(htab_t* t);
+
+// Insert or replace. 0 on success, -1 if out of memory.
+int   htab_put_u64(htab_t* t, uint64_t key, void* value);
+void* htab_get_u64(htab_t* t, uint64_t key);
+// 1 if the key was present
+int   htab_del_u64(htab_t* t, uint64_t key);
+
+int   htab_put_str(htab_t* t, const char* key, void* value);
+void* htab_get_str(htab_t* t, const char* key);
+int   htab_del_str(htab_t* t, const char* key);
+
+static inline size_t htab_count(const htab_t* t) { return t->count; }
+
+// Times insert/lookup/delete of 'n' integer keys and logs the rates (needs a running timer)
+void  htab_benchmark(size_t n);
@@ -10,10 +10,34 @@ void* kmalloc(size_t size);
 void  kfree(void* ptr);
 void* krealloc(void* ptr, size_t new_size);
 void* kcalloc(size_t num, size_t size);
+// Allocate with 'align' (power of two) alignment; release with kfree.
+void* kmalloc_aligned(size_t size, size_t align);
 
 // Heap stats
 size_t heap_total_bytes(void);
 size_t heap_used_bytes(void);
 size_t heap_peak_bytes(void);
 
+// Allocator health (large-block TLSF part; slab-served requests are not counted)
+struct heap_frag_stats {
+    size_t   free_bytes;       // payload bytes on the free lists
+    size_t   free_blocks;
+    size_t   largest_free;     // biggest single free block
+    uint64_t searches;         // free-list searches (one per large kmalloc)
+    uint64_t search_steps;     // sum of search lengths, see search_len_avg
+    uint64_t grows;            // searches that had to grow the heap
+    uint64_t failures;         // searches that found nothing even after growing
+    uint64_t realloc_inplace;  // krealloc grew the block where it was
+    uint64_t realloc_shrink;   // krealloc kept the block (same size or smaller)
+    uint64_t realloc_moved;    // krealloc had to allocate, copy and free
+};
+void heap_get_frag_stats(struct heap_frag_stats* out);
+
+// Free memory at the end of the heap is returned to the frame allocator only
+// while the heap is larger than this (rounded up to 2 MiB).
+void heap_set_keep(size_t bytes);
+
+// Create /sys/kernel/mm/* statistics files (call after sysfs is mounted)
+void mm_sysfs_init(void);
+
 
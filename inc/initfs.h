@@ -5,7 +5,8 @@
 
 /* Scan multiboot2 tags for a module with name `module_name`.
    If found, unpack cpio newc archive from the module into the VFS.
-   Returns 0 on success, negative on error, 1 if module not found. */
+   "070702" entries are checked against their c_check sum; bad files are skipped.
+   Returns 0 on success, negative on error (-3: some checksums failed), 1 if module not found. */
 int initfs_process_multiboot_module(uint32_t multiboot_magic, uint32_t multiboot_info, const char *module_name);
 
 
@@ -6,6 +6,7 @@
 // Page size and table constants
 #define PAGE_SIZE_4K             4096ULL
 #define PAGE_SIZE_2M             (2ULL * 1024 * 1024)
+#define PAGE_SIZE_1G             (1024ULL * 1024 * 1024)
 #define PT_ENTRIES               512ULL
 
 // Paging flags (x86_64 long mode)
@@ -16,13 +17,26 @@
 #define PG_PCD                   (1ULL << 4)
 #define PG_ACCESSED              (1ULL << 5)
 #define PG_DIRTY                 (1ULL << 6)
-#define PG_PS_2M                 (1ULL << 7)   // set in PD entry for 2MiB page
+#define PG_PS_2M                 (1ULL << 7)   // set in PD entry for 2MiB page (PDPT entry: 1GiB page)
 #define PG_GLOBAL                (1ULL << 8)
 #define PG_NX                    (1ULL << 63)  // if EFER.NXE is enabled
 
 // Initialize paging helpers (assumes bootstrap tables are already active)
 void paging_init(void);
 
+// Page tables are allocated from the frame allocator; large pages in the way of a
+// smaller mapping are split into 512 entries with the same attributes.
+
+// Map one 4KiB page at 'va' to physical 'pa'. Returns 0 on success, <0 on error.
+int map_page_4k(uint64_t va, uint64_t pa, uint64_t flags);
+
+// Unmap one 4KiB page (splitting a covering large page if needed).
+int unmap_page_4k(uint64_t va);
+
+// Map one 1GiB page; fails with -1 when the CPU lacks 1GiB page support.
+int map_page_1g(uint64_t va, uint64_t pa, uint64_t flags);
+int paging_has_1g_pages(void);
+
 // Map one 2MiB page at 'va' to physical 'pa' with flags (PG_PRESENT|PG_RW|...)
 // Returns 0 on success, <0 on error.
 int map_page_2m(uint64_t va, uint64_t pa, uint64_t flags);
@@ -30,6 +44,47 @@ int map_page_2m(uint64_t va, uint64_t pa, uint64_t flags);
 // Unmap one 2MiB page at 'va'. No free of frames; only removes mapping.
 int unmap_page_2m(uint64_t va);
 
+// Map [va, va+size) to [pa, pa+size) using the largest page size that the
+// alignment of each piece allows (1GiB, 2MiB, 4KiB). All arguments must be
+// 4KiB aligned. On failure nothing of the range stays mapped.
+int map_range(uint64_t va, uint64_t pa, uint64_t size, uint64_t flags);
+
+// Unmap [va, va+size), splitting large pages that are only partially covered.
+// Frames are not freed.
+int unmap_range(uint64_t va, uint64_t size);
+
+// Same, calling 'release' with the physical base and size of every mapping removed
+// (a partially covered large page is split first and reported per 4KiB piece).
+// 'release' runs only after the TLB flush for that mapping: at once outside a
+// transaction, at paging_batch_commit inside one.
+int unmap_range_release(uint64_t va, uint64_t size, void (*release)(uint64_t pa, uint64_t bytes));
+
+// Translate a mapped virtual address; returns 0 if it is not mapped.
+uint64_t virt_to_phys(uint64_t va);
+
+// Number of page tables allocated at runtime (boot tables not included)
+size_t paging_tables_in_use(void);
+
+// Mapping transactions: TLB invalidations of every map/unmap between begin and
+// commit are collected and issued at commit, or replaced by one full flush when
+// more than the flush threshold (default 32 pages, at most 64) are pending.
+// Transactions nest; only the outermost commit flushes. Page tables and
+// released frames unlinked inside a transaction are freed after that flush.
+void paging_batch_begin(void);
+void paging_batch_commit(void);
+void paging_set_flush_threshold(size_t pages);
+
+struct paging_tlb_stats {
+    uint64_t invlpg;        // single-page invalidations issued
+    uint64_t full_flushes;  // CR3 reloads / CR4.PGE toggles
+    uint64_t batches;       // committed transactions that had pending pages
+    uint64_t deferred;      // invalidations queued inside transactions
+};
+void paging_get_tlb_stats(struct paging_tlb_stats* out);
+
+// Creates /sys/kernel/mm/tlb and /sys/kernel/mm/tlb_flush_threshold
+void paging_sysfs_init(void);
+
 // Invalidate TLB for given virtual address
 void invlpg(void* va);
 
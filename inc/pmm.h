@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Physical page-frame allocator (binary buddy system). Built from the multiboot2
+// memory map; hands out naturally aligned blocks of 2^order 4 KiB frames.
+// Only RAM inside the boot identity map (below 4 GiB) is managed, so a frame's
+// physical address can also be used as a pointer.
+
+#define PMM_FRAME_SIZE   4096ULL
+#define PMM_MAX_ORDER    9        // order 9 = 512 frames = 2 MiB
+
+// Parse the memory map and build the free lists. Reserves the low 1 MiB, the
+// kernel image, the multiboot info and the boot modules. Call before heap_init.
+void     pmm_init(uint32_t multiboot_magic, uint32_t multiboot_info);
+
+// Take [base, base+len) out of the free pool (e.g. memory claimed before pmm_init).
+void     pmm_reserve_range(uint64_t base, uint64_t len);
+
+// Returns the physical address of a 2^order frame block, 0 when out of memory.
+uint64_t pmm_alloc_pages(unsigned order);
+void     pmm_free_pages(uint64_t pa, unsigned order);
+
+static inline uint64_t pmm_alloc_page(void) { return pmm_alloc_pages(0); }
+static inline void     pmm_free_page(uint64_t pa) { pmm_free_pages(pa, 0); }
+
+// Zero-filled block; orders 0 and 1 come from the pre-zeroed pool when possible,
+// otherwise the block is cleared here.
+uint64_t pmm_alloc_zeroed(unsigned order);
+
+// Idle-time work: clear up to 'budget' free blocks into the pre-zeroed pool.
+// Returns nonzero if anything was done (i.e. it is worth calling again).
+int      pmm_zero_idle(unsigned budget);
+
+struct pmm_zero_stats {
+    uint64_t hits;       // zeroed allocations served from the pool
+    uint64_t misses;     // zeroed allocations that had to clear memory inline
+    uint64_t zeroed;     // frames cleared in idle time
+    size_t   pooled;     // frames currently parked in the pool
+};
+void     pmm_get_zero_stats(struct pmm_zero_stats* out);
+
+size_t   pmm_total_bytes(void);   // RAM managed by the allocator
+size_t   pmm_free_bytes(void);
+size_t   pmm_free_blocks(unsigned order);
+
+// Creates /sys/kernel/mm/buddyinfo and /sys/kernel/mm/zeropool
+void     pmm_sysfs_init(void);
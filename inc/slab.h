@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size-class (slab) front end for kmalloc. Requests up to SLAB_MAX_SIZE bytes are
+// served from per-class object caches carved out of 4 KiB slab pages; larger ones
+// go to the general heap. All operations are O(1).
+
+#define SLAB_PAGE_SIZE   4096
+#define SLAB_MAX_SIZE    256
+#define SLAB_NUM_CLASSES 8
+
+struct slab_class_stats {
+    size_t   obj_size;     // object size of the class
+    size_t   objs_per_page;
+    size_t   active;       // objects currently handed out
+    size_t   pages;        // slab pages owned by the class (incl. cached empty ones)
+    uint64_t hits;         // allocations served from the class free lists
+    uint64_t misses;       // allocations that needed a new page from the heap
+    uint64_t frees;
+};
+
+// Heap window [base, base+span) that slab pages are carved from (used to tell
+// slab objects from heap blocks in kfree/krealloc).
+void   slab_init(uintptr_t base, size_t span);
+
+void*  slab_alloc(size_t size);       // 0 if size > SLAB_MAX_SIZE or out of memory
+void   slab_free(void* ptr);
+int    slab_owns(const void* ptr);
+size_t slab_obj_size(const void* ptr);
+
+int    slab_get_stats(int cls, struct slab_class_stats* out);
+
+// Creates /sys/kernel/mm/slabinfo
+void   slab_sysfs_init(void);
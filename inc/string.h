@@ -16,16 +16,38 @@ char* strchr(const char* str, int c);
 char* strrchr(const char* str, int c);
 char* strstr(const char* haystack, const char* needle);
 char* strtok(char* str, const char* delim);
+char* strtok_r(char* str, const char* delim, char** saveptr);
 int trim(char* str);
 // split string by any delimiters in delim; returns NULL-terminated array of tokens
 // writes number of tokens to *n if n != NULL
+// the array and the token strings are one allocation: release with a single kfree
 char** split(const char* str, char* delim, int* n);
 
+// non-allocating tokenizer: yields (pointer, length) views into the source string
+typedef struct { const char* ptr; size_t len; } str_span_t;
+typedef struct { const char* pos; const char* end; uint64_t set[4]; } str_iter_t;
+void str_iter_init(str_iter_t* it, const char* str, const char* delim);
+// iterate over the first len bytes only (str need not be NUL-terminated)
+void str_iter_init_n(str_iter_t* it, const char* str, size_t len, const char* delim);
+// stores the next token in *out; returns 0 when the string is exhausted
+int str_iter_next(str_iter_t* it, str_span_t* out);
+// span equals the whole of str
+int str_span_eq(str_span_t span, const char* str);
+
 // functions for working with memory
 void* memcpy(void* dest, const void* src, size_t n);
 void* memmove(void* dest, const void* src, size_t n);
 void* memset(void* ptr, int value, size_t n);
 int memcmp(const void* ptr1, const void* ptr2, size_t n);
+void* memchr(const void* ptr, int c, size_t n);
+// like memchr, but returns the last occurrence
+void* memrchr(const void* ptr, int c, size_t n);
+
+// pick memcpy/memset variants from CPUID (call once at boot; safe defaults before)
+void mem_init(void);
+const char* mem_variant_name(void);
+// time every usable variant and log GB/s (needs the heap and a running timer)
+void mem_benchmark(void);
 
 // additional functions
 void itoa(int value, char* str, int base);
@@ -26,4 +26,9 @@ int sysfs_remove(const char *path);
 int sysfs_fill_stat(struct fs_file *file, struct stat *st);
 int sysfs_chmod(const char *path, mode_t mode);
 
+/* Append one printf-style line (up to 255 chars) to a show() buffer at 'pos';
+   returns the new position, truncating instead of overflowing 'size'. */
+size_t sysfs_emit_at(char *buf, size_t size, size_t pos, const char *fmt, ...);
 
+/* Parse a decimal number written to a store() callback (not NUL-terminated). */
+int sysfs_parse_ulong(const char *buf, size_t size, unsigned long *out);
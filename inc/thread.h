@@ -2,6 +2,7 @@
 #define THREAD_H
 #include <stdint.h>
 #include "context.h"
+#include "timer.h"
 
 typedef enum {
         THREAD_READY,
@@ -13,6 +14,13 @@ typedef enum {
 
 #define THREAD_MAX_FD 16
 
+// Priority levels: 0 is the highest. Each level has its own FIFO run queue.
+#define THREAD_PRIO_LEVELS      32
+#define THREAD_PRIO_DEFAULT     16
+#define THREAD_PRIO_BACKGROUND  20
+// Interactive threads (those that sleep or wait for input) run up to this many levels above their base
+#define THREAD_BONUS_MAX        4
+
 typedef struct thread {
         context_t context;
         uint64_t kernel_stack;         // kernel mode stack
@@ -24,8 +32,19 @@ typedef struct thread {
         struct thread* next;
         uint64_t tid;
         char name[32];                 // thread name (urmomissofaturmomissofaturmomiss)
-        uint32_t sleep_until;          // sleep until (in timer ticks)
+        uint64_t sleep_until;          // sleep until (timer_now_ms)
+        ktimer_t sleep_timer;          // wakes the thread from thread_sleep
         uint64_t clear_child_tid;      // clear child tid
+        void* fpu_state;               // FPU/SSE save area (see fpu.h), NULL until allocated
+        uint8_t fpu_used;              // has a state of its own (touched the FPU at least once)
+        uint8_t base_prio;             // set by thread_set_priority
+        uint8_t prio;                  // effective: base_prio - bonus, the run queue it is on
+        uint8_t bonus;                 // interactivity boost, 0..THREAD_BONUS_MAX
+        struct thread* rq_next;        // run queue, sleep list or zombie list links
+        struct thread* rq_prev;
+        int slot;                      // index in the thread registry
+        uint64_t stack_base;           // kernel stack allocation, recycled with the thread_t
+        uint8_t stack_pmm;             // stack is a pmm block with a guard page, not kmalloc
         //fs_file_t* fds[THREAD_MAX_FD];
         /* POSIX credentials */
         uid_t euid;
@@ -36,17 +55,33 @@ extern int init;
 
 void thread_init();
 thread_t* thread_create(void (*entry)(void), const char* name);
+// Same, queued at base priority 'prio' from the start
+thread_t* thread_create_prio(void (*entry)(void), const char* name, int prio);
+// Give the CPU to any other ready thread, even a lower-priority one
 void thread_yield();
+// Timer tick: the current thread's slice is over, run the highest-priority ready thread
 void thread_schedule();
 thread_t* thread_current();
+// Threads are looked up by TID through a hash table. TIDs are never reused; a
+// terminated thread's stack and thread_t are freed later by the reaper, so a
+// thread_t* must not be kept past its thread's exit.
 void thread_stop(int pid);
 thread_t* thread_get(int pid);
 int thread_get_pid(const char* name);
 void thread_block(int pid);
 void thread_unblock(int pid);
 int thread_get_state(int pid);
+// Threads in the registry, including terminated ones not reaped yet
 int thread_get_count();
+// Base priority (0..THREAD_PRIO_LEVELS-1, lower runs first). 0 / the priority on success, -1 if no such thread
+int thread_set_priority(int pid, int prio);
+int thread_get_priority(int pid);
 void thread_sleep(uint32_t ms);
+// Wait for an interrupt, doing a slice of background work (reaping, frame pre-zeroing) first.
+// Call with interrupts disabled right after checking the wait condition; returns with them enabled.
+void thread_idle(void);
+// Some thread other than the current one is waiting for the CPU
+int thread_has_ready(void);
 
 // register user thread (process) for display in list
 thread_t* thread_register_user(uint64_t user_rip, uint64_t user_rsp, const char* name);
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernel clock and one-shot callback timers.
+//
+// The clock counts microseconds since timer_start() and is advanced by the
+// tick source that kernel_main selected (APIC timer or PIT). Timers live in a
+// hierarchical wheel with 1 ms resolution: 4 levels of 64 slots cover about
+// 4.6 hours, later deadlines wait in the last level and are re-filed as time
+// goes on. Adding and cancelling are O(1); a tick only touches the slot that
+// is due, plus a cascade from the next level every 64 ms.
+//
+// Callbacks run in the timer interrupt with interrupts disabled: they must be
+// short and must not allocate or block. A callback may re-add its own timer.
+//
+// NO_HZ: a source that can fire one-shot interrupts lets the periodic tick stop
+// while nothing needs it - when the CPU idles, or when a single thread is
+// runnable and there is nobody to preempt it for. The next interrupt is then
+// programmed for the next timer deadline (at most TIMER_NOHZ_MAX_MS away), and
+// the clock is read between interrupts from the source's counter.
+
+typedef void (*ktimer_fn_t)(void* arg);
+
+typedef struct ktimer {
+    uint64_t expires;          // deadline, timer_now_ms() scale
+    ktimer_fn_t fn;
+    void* arg;
+    struct ktimer* next;
+    struct ktimer* prev;
+    struct ktimer** slot;      // wheel slot while pending, NULL otherwise
+} ktimer_t;
+
+#define TIMER_NOHZ_MAX_MS  1000
+
+typedef struct timer_source {
+    const char* name;
+    // Microseconds since the source last reported time through timer_tick
+    uint32_t (*elapsed_us)(void);
+    // Stop the periodic tick and fire once after 'us'; returns the time elapsed
+    // in the interrupted period. When that interrupt fires, the source goes back
+    // to periodic ticking before it calls timer_tick.
+    uint32_t (*oneshot)(uint32_t us);
+    // Cancel a pending one-shot and resume the periodic tick; returns the time
+    // elapsed in the one-shot.
+    uint32_t (*periodic)(void);
+} timer_source_t;
+
+// Start the clock; called once the tick source is chosen and running. 'src' may
+// be NULL for a plain periodic source (no NO_HZ, clock advances per tick only).
+void     timer_start(const timer_source_t* src);
+int      timer_running(void);
+// Called by the tick source from its interrupt handler: 'us' microseconds have passed.
+void     timer_tick(uint32_t us);
+
+// Interrupts must be disabled. enter: nothing needs the tick before the next
+// timer, switch the source to one-shot. exit: resume the periodic tick (a thread
+// became runnable or the idle halt ended). Both are no-ops when not applicable.
+void     timer_nohz_enter(void);
+void     timer_nohz_exit(void);
+int      timer_nohz_active(void);
+
+uint64_t timer_now_ms(void);
+uint64_t timer_now_us(void);
+
+// Run fn(arg) once, 'delay_ms' from now (0: on the next tick). The ktimer_t is
+// owned by the caller and must stay valid while pending. Re-adding a pending
+// timer moves it.
+void     timer_add(ktimer_t* t, uint64_t delay_ms, ktimer_fn_t fn, void* arg);
+// 1 if the timer was pending (it will not fire), 0 if it had already fired or was never added.
+int      timer_cancel(ktimer_t* t);
+static inline int timer_pending(const ktimer_t* t) { return t->slot != NULL; }
+
+// Sleep the calling thread. Blocks in the scheduler when threads are up and
+// interrupts are enabled, otherwise busy-waits on the clock.
+void     timer_sleep_ms(uint32_t ms);
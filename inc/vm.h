@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Reserve-only virtual memory. vm_reserve hands out a range of kernel virtual
+// address space without any backing; the page fault handler allocates and zeroes
+// a 4 KiB frame the first time each page is touched. Sparse buffers therefore
+// only cost the pages that were actually written or read.
+
+#define VM_PAGE_SIZE  4096ULL
+
+// Reserve 'size' bytes (rounded up to 4 KiB) of demand-zero memory; 0 on failure.
+// flags: extra PG_* bits for the pages (PG_PRESENT|PG_RW are implied).
+void*  vm_reserve(size_t size, uint64_t flags);
+
+// Unmap the region and return every populated frame. 'addr' must come from vm_reserve.
+void   vm_release(void* addr);
+
+// Map existing frames back to back at a fresh address of the window (e.g. to
+// view scattered pages as one buffer). The frames stay owned by the caller:
+// vm_release only removes the mapping.
+void*  vm_map_frames(const uint64_t* frames, size_t count, uint64_t flags);
+
+// Size of the region starting at 'addr' (0 if it is not a vm_reserve region).
+size_t vm_region_size(const void* addr);
+int    vm_owns(const void* addr);
+
+// Called from the #PF handler with CR2 and the error code. Returns 0 when the
+// fault was a first touch of a reserved page and has been resolved.
+int    vm_handle_fault(uint64_t addr, uint64_t error_code);
+
+struct vm_stats {
+    uint64_t faults;         // demand-zero faults resolved
+    uint64_t failed;         // faults in a region that could not be backed (out of memory)
+    uint64_t cycles_total;   // TSC cycles spent resolving faults
+    uint64_t cycles_max;
+    size_t   regions;        // live regions
+    size_t   reserved;       // bytes of address space reserved
+    size_t   resident;       // bytes actually backed by frames
+};
+void   vm_get_stats(struct vm_stats* out);
+
+// Creates /sys/kernel/mm/vm
+void   vm_sysfs_init(void);
@@ -0,0 +1,101 @@
+#include <crc32.h>
+
+// ---- CRC-32 / CRC-32C ----
+// Табличный вариант обрабатывает 8 байт за шаг (slicing-by-8): таблица k
+// содержит CRC байта, за которым следуют k нулевых байт, так что восемь
+// независимых поисков складываются через XOR.
+// Инструкция crc32 из SSE4.2 работает только на регистрах общего
+// назначения, поэтому ей не нужно сохранение xmm и выключение прерываний.
+
+#define POLY_CRC32   0xEDB88320u     // отражённый 0x04C11DB7
+#define POLY_CRC32C  0x82F63B78u     // отражённый 0x1EDC6F41
+
+typedef uint64_t __attribute__((may_alias, aligned(1))) u64_unaligned;
+
+static uint32_t tab_crc32[8][256];
+static uint32_t tab_crc32c[8][256];
+static int tab_crc32_ready = 0;
+static int tab_crc32c_ready = 0;
+static int crc32c_hw = -1;           // -1: ещё не проверяли CPUID
+
+static void build_tables(uint32_t tab[8][256], uint32_t poly) {
+        for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+                tab[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+                for (int t = 1; t < 8; t++) {
+                        uint32_t prev = tab[t - 1][i];
+                        tab[t][i] = (prev >> 8) ^ tab[0][prev & 0xFF];
+                }
+        }
+}
+
+static uint32_t crc_slice8(uint32_t tab[8][256], uint32_t crc, const uint8_t* p, size_t len) {
+        // выравниваем до 8 байт, чтобы основной цикл читал целые слова
+        while (len && ((uintptr_t)p & 7)) {
+                crc = (crc >> 8) ^ tab[0][(crc ^ *p++) & 0xFF];
+                len--;
+        }
+        while (len >= 8) {
+                uint64_t w = *(const u64_unaligned*)p ^ crc;
+                crc = tab[7][w & 0xFF] ^ tab[6][(w >> 8) & 0xFF] ^
+                      tab[5][(w >> 16) & 0xFF] ^ tab[4][(w >> 24) & 0xFF] ^
+                      tab[3][(w >> 32) & 0xFF] ^ tab[2][(w >> 40) & 0xFF] ^
+                      tab[1][(w >> 48) & 0xFF] ^ tab[0][w >> 56];
+                p += 8;
+                len -= 8;
+        }
+        while (len--) crc = (crc >> 8) ^ tab[0][(crc ^ *p++) & 0xFF];
+        return crc;
+}
+
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t len) {
+        while (len && ((uintptr_t)p & 7)) {
+                __asm__("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+                p++;
+                len--;
+        }
+        uint64_t c = crc;
+        while (len >= 8) {
+                __asm__("crc32q %1, %0" : "+r"(c) : "rm"(*(const u64_unaligned*)p));
+                p += 8;
+                len -= 8;
+        }
+        crc = (uint32_t)c;
+        while (len--) {
+                __asm__("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+                p++;
+        }
+        return crc;
+}
+
+static int cpu_has_sse42(void) {
+        uint32_t a, b, c, d;
+        __asm__ volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1), "c"(0));
+        return (c >> 20) & 1;
+}
+
+uint32_t crc32(uint32_t crc, const void* buf, size_t len) {
+        if (!tab_crc32_ready) {
+                build_tables(tab_crc32, POLY_CRC32);
+                tab_crc32_ready = 1;
+        }
+        return ~crc_slice8(tab_crc32, ~crc, (const uint8_t*)buf, len);
+}
+
+uint32_t crc32c(uint32_t crc, const void* buf, size_t len) {
+        if (crc32c_hw < 0) crc32c_hw = cpu_has_sse42();
+        if (crc32c_hw) return ~crc32c_sse42(~crc, (const uint8_t*)buf, len);
+        if (!tab_crc32c_ready) {
+                build_tables(tab_crc32c, POLY_CRC32C);
+                tab_crc32c_ready = 1;
+        }
+        return ~crc_slice8(tab_crc32c, ~crc, (const uint8_t*)buf, len);
+}
+
+const char* crc32c_impl_name(void) {
+        if (crc32c_hw < 0) crc32c_hw = cpu_has_sse42();
+        return crc32c_hw ? "sse4.2" : "slice8";
+}
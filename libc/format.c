@@ -0,0 +1,249 @@
+#include <format.h>
+#include <string.h>
+#include <stdint.h>
+
+// ---- общий движок printf ----
+// Текст собирается в буфере на стеке и уходит в приёмник целыми кусками.
+// Обычный текст между спецификаторами копируется одним memcpy.
+
+typedef struct {
+        fmt_sink_t sink;
+        void* ctx;
+        size_t len;             // занято в buf
+        size_t total;           // всего выведено символов
+        char buf[FMT_CHUNK];
+} fmt_out_t;
+
+static void out_flush(fmt_out_t* o) {
+        if (o->len) o->sink(o->ctx, o->buf, o->len);
+        o->len = 0;
+}
+
+static void out_write(fmt_out_t* o, const char* s, size_t n) {
+        o->total += n;
+        while (n) {
+                if (o->len == FMT_CHUNK) out_flush(o);
+                size_t part = FMT_CHUNK - o->len;
+                if (part > n) part = n;
+                memcpy(o->buf + o->len, s, part);
+                o->len += part;
+                s += part;
+                n -= part;
+        }
+}
+
+static void out_pad(fmt_out_t* o, char ch, int count) {
+        if (count <= 0) return;
+        o->total += (size_t)count;
+        while (count) {
+                if (o->len == FMT_CHUNK) out_flush(o);
+                size_t part = FMT_CHUNK - o->len;
+                if (part > (size_t)count) part = (size_t)count;
+                memset(o->buf + o->len, ch, part);
+                o->len += part;
+                count -= (int)part;
+        }
+}
+
+// Цифры пишутся с конца буфера; возвращает их количество
+static int utoa_tail(unsigned long long v, unsigned base, int upper, char* end) {
+        const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+        int n = 0;
+        do {
+                *--end = digits[v % base];
+                v /= base;
+                n++;
+        } while (v);
+        return n;
+}
+
+enum { LEN_DEF, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_Z };
+
+int fmt_vformat(fmt_sink_t sink, void* ctx, const char* fmt, va_list ap) {
+        fmt_out_t o;
+        o.sink = sink;
+        o.ctx = ctx;
+        o.len = 0;
+        o.total = 0;
+        const char* p = fmt;
+        while (*p) {
+                if (*p != '%') {
+                        const char* run = p;
+                        while (*p && *p != '%') p++;
+                        out_write(&o, run, (size_t)(p - run));
+                        continue;
+                }
+                p++;
+                // флаги
+                int left = 0, plus = 0, space = 0, alt = 0, zero = 0;
+                for (;;) {
+                        if (*p == '-') left = 1;
+                        else if (*p == '+') plus = 1;
+                        else if (*p == ' ') space = 1;
+                        else if (*p == '#') alt = 1;
+                        else if (*p == '0') zero = 1;
+                        else break;
+                        p++;
+                }
+                // ширина
+                int width = 0;
+                if (*p == '*') {
+                        width = va_arg(ap, int);
+                        if (width < 0) { left = 1; width = -width; }
+                        p++;
+                } else {
+                        while (*p >= '0' && *p <= '9') width = width * 10 + (*p++ - '0');
+                }
+                // точность
+                int prec = -1;
+                if (*p == '.') {
+                        p++;
+                        if (*p == '*') { prec = va_arg(ap, int); p++; }
+                        else { prec = 0; while (*p >= '0' && *p <= '9') prec = prec * 10 + (*p++ - '0'); }
+                }
+                // совместимость с нестандартным %10-4x (ширина-точность)
+                if (prec < 0 && *p == '-') {
+                        p++;
+                        prec = 0;
+                        while (*p >= '0' && *p <= '9') prec = prec * 10 + (*p++ - '0');
+                }
+                // длина
+                int len = LEN_DEF;
+                if (*p == 'h') { p++; if (*p == 'h') { len = LEN_HH; p++; } else len = LEN_H; }
+                else if (*p == 'l') { p++; if (*p == 'l') { len = LEN_LL; p++; } else len = LEN_L; }
+                else if (*p == 'z' || *p == 'j' || *p == 't') { len = LEN_Z; p++; }
+
+                char spec = *p ? *p++ : '\0';
+                char num[24];
+                char* end = num + sizeof(num);
+                int ndigits = 0;
+                char prefix[2];
+                int plen = 0;
+
+                switch (spec) {
+                case 'c': {
+                        char ch = (char)va_arg(ap, int);
+                        if (!left) out_pad(&o, ' ', width - 1);
+                        out_write(&o, &ch, 1);
+                        if (left) out_pad(&o, ' ', width - 1);
+                        continue;
+                }
+                case 's': {
+                        const char* s = va_arg(ap, const char*);
+                        if (!s) s = "(null)";
+                        size_t slen = prec >= 0 ? strnlen(s, (size_t)prec) : strlen(s);
+                        int pad = width > (int)slen ? width - (int)slen : 0;
+                        if (!left) out_pad(&o, ' ', pad);
+                        out_write(&o, s, slen);
+                        if (left) out_pad(&o, ' ', pad);
+                        continue;
+                }
+                case 'd': case 'i': {
+                        long long v;
+                        if (len == LEN_LL) v = va_arg(ap, long long);
+                        else if (len == LEN_L || len == LEN_Z) v = va_arg(ap, long);
+                        else v = va_arg(ap, int);
+                        if (len == LEN_HH) v = (signed char)v;
+                        else if (len == LEN_H) v = (short)v;
+                        unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+                        if (v < 0) prefix[plen++] = '-';
+                        else if (plus) prefix[plen++] = '+';
+                        else if (space) prefix[plen++] = ' ';
+                        ndigits = (u == 0 && prec == 0) ? 0 : utoa_tail(u, 10, 0, end);
+                        break;
+                }
+                case 'u': case 'x': case 'X': case 'o': case 'p': {
+                        unsigned base = 10;
+                        int upper = spec == 'X';
+                        unsigned long long u;
+                        if (spec == 'p') {
+                                u = (unsigned long long)(uintptr_t)va_arg(ap, void*);
+                                alt = 1;
+                        } else if (len == LEN_LL) u = va_arg(ap, unsigned long long);
+                        else if (len == LEN_L || len == LEN_Z) u = va_arg(ap, unsigned long);
+                        else u = va_arg(ap, unsigned int);
+                        if (len == LEN_HH) u = (unsigned char)u;
+                        else if (len == LEN_H) u = (unsigned short)u;
+                        if (spec == 'x' || spec == 'X' || spec == 'p') base = 16;
+                        else if (spec == 'o') base = 8;
+                        ndigits = (u == 0 && prec == 0) ? 0 : utoa_tail(u, base, upper, end);
+                        if (alt && base == 16 && u != 0) { prefix[0] = '0'; prefix[1] = upper ? 'X' : 'x'; plen = 2; }
+                        else if (alt && base == 8 && (u != 0 || ndigits == 0)) { prefix[0] = '0'; plen = 1; }
+                        break;
+                }
+                case '%':
+                        out_write(&o, "%", 1);
+                        continue;
+                case '\0':
+                        continue;
+                default:
+                        out_write(&o, &spec, 1);
+                        continue;
+                }
+
+                // целые: [пробелы][знак/префикс][нули][цифры][пробелы]
+                int prec_zeros = 0;
+                if (prec >= 0) {
+                        zero = 0; // при точности флаг 0 игнорируется
+                        if (prec > ndigits) prec_zeros = prec - ndigits;
+                }
+                int field = plen + prec_zeros + ndigits;
+                int pad = width > field ? width - field : 0;
+                if (!left && !zero) out_pad(&o, ' ', pad);
+                out_write(&o, prefix, (size_t)plen);
+                if (!left && zero) out_pad(&o, '0', pad);
+                out_pad(&o, '0', prec_zeros);
+                out_write(&o, end - ndigits, (size_t)ndigits);
+                if (left) out_pad(&o, ' ', pad);
+        }
+        out_flush(&o);
+        return (int)o.total;
+}
+
+int fmt_format(fmt_sink_t sink, void* ctx, const char* fmt, ...) {
+        va_list ap;
+        va_start(ap, fmt);
+        int r = fmt_vformat(sink, ctx, fmt, ap);
+        va_end(ap);
+        return r;
+}
+
+// ---- вывод в буфер ----
+
+typedef struct {
+        char* buf;
+        size_t cap;
+        size_t len;
+} buf_sink_t;
+
+static void buf_sink(void* p, const char* s, size_t n) {
+        buf_sink_t* b = (buf_sink_t*)p;
+        if (b->len + 1 < b->cap) {
+                size_t room = b->cap - 1 - b->len;
+                memcpy(b->buf + b->len, s, n < room ? n : room);
+        }
+        b->len += n;
+}
+
+int vsnprintf(char* out, size_t outsz, const char* fmt, va_list ap) {
+        buf_sink_t b = { out, out ? outsz : 0, 0 };
+        int r = fmt_vformat(buf_sink, &b, fmt, ap);
+        if (b.cap) out[b.len < b.cap ? b.len : b.cap - 1] = '\0';
+        return r;
+}
+
+int snprintf(char* out, size_t outsz, const char* fmt, ...) {
+        va_list ap;
+        va_start(ap, fmt);
+        int r = vsnprintf(out, outsz, fmt, ap);
+        va_end(ap);
+        return r;
+}
+
+int sprintf(char* out, const char* fmt, ...) {
+        va_list ap;
+        va_start(ap, fmt);
+        int r = vsnprintf(out, (size_t)-1, fmt, ap);
+        va_end(ap);
+        return r;
+}
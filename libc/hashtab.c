@@ -0,0 +1,229 @@
+#include <hashtab.h>
+#include <string.h>
+#include <heap.h>
+#include <apic_timer.h>
+
+// ---- хеш-таблица с открытой адресацией (Robin Hood) ----
+// При вставке элемент, ушедший от своей ячейки дальше, вытесняет «более
+// богатый», поэтому длины проб выравниваются и поиск можно прекращать, как
+// только встречена ячейка с меньшим расстоянием. Удаление сдвигает хвост
+// цепочки назад, так что надгробия в основном массиве не нужны; они бывают
+// только в старом массиве во время постепенного переноса.
+
+#define HTAB_MIN_CAP   16
+#define HTAB_MIGRATE   16      // сколько старых ячеек переносить за вызов
+
+// финализатор MurmurHash3: хорошо перемешивает последовательные ключи
+static uint32_t hash_u64(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return (uint32_t)k;
+}
+
+// FNV-1a
+static uint32_t hash_str(const char* s) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        while (*s) {
+                h ^= (uint8_t)*s++;
+                h *= 0x100000001b3ULL;
+        }
+        return (uint32_t)(h ^ (h >> 32));
+}
+
+static inline int key_eq(const htab_t* t, const htab_slot_t* s, uint64_t key, uint32_t hash) {
+        if (s->hash != hash) return 0;
+        if (t->kind == HTAB_KEY_U64) return s->key == key;
+        return strcmp((const char*)(uintptr_t)s->key, (const char*)(uintptr_t)key) == 0;
+}
+
+static htab_slot_t* find_in(const htab_t* t, htab_slot_t* slots, size_t cap, uint64_t key, uint32_t hash) {
+        size_t mask = cap - 1;
+        size_t idx = hash & mask;
+        for (uint32_t d = 1; ; d++) {
+                htab_slot_t* s = &slots[idx];
+                // пустая ячейка или более короткая проба: дальше ключа быть не может
+                if (s->dist < d) return NULL;
+                if (!s->dead && key_eq(t, s, key, hash)) return s;
+                idx = (idx + 1) & mask;
+        }
+}
+
+// ключа в основном массиве нет, место есть
+static void insert_new(htab_t* t, uint64_t key, uint32_t hash, void* value) {
+        size_t mask = t->cap - 1;
+        size_t idx = hash & mask;
+        htab_slot_t cur = { key, value, hash, 1, 0 };
+        for (;;) {
+                htab_slot_t* s = &t->slots[idx];
+                if (s->dist == 0) {
+                        *s = cur;
+                        t->used++;
+                        return;
+                }
+                if (s->dist < cur.dist) {
+                        htab_slot_t tmp = *s;
+                        *s = cur;
+                        cur = tmp;
+                }
+                idx = (idx + 1) & mask;
+                cur.dist++;
+        }
+}
+
+static void delete_at(htab_t* t, size_t idx) {
+        size_t mask = t->cap - 1;
+        size_t next = (idx + 1) & mask;
+        while (t->slots[next].dist > 1) {
+                t->slots[idx] = t->slots[next];
+                t->slots[idx].dist--;
+                idx = next;
+                next = (next + 1) & mask;
+        }
+        t->slots[idx].dist = 0;
+        t->used--;
+}
+
+static void migrate(htab_t* t, size_t steps) {
+        while (t->old && steps--) {
+                htab_slot_t* s = &t->old[t->old_pos++];
+                if (s->dist && !s->dead) {
+                        insert_new(t, s->key, s->hash, s->value);
+                        s->dead = 1;    // ячейка остаётся занятой, чтобы не рвать цепочки проб
+                }
+                if (t->old_pos == t->old_cap) {
+                        kfree(t->old);
+                        t->old = NULL;
+                        t->old_cap = t->old_pos = 0;
+                }
+        }
+}
+
+static int grow(htab_t* t) {
+        // второй перенос одновременно не ведём: сначала дочищаем старый массив
+        migrate(t, (size_t)-1);
+        htab_slot_t* slots = (htab_slot_t*)kcalloc(t->cap * 2, sizeof(htab_slot_t));
+        if (!slots) return -1;
+        t->old = t->slots;
+        t->old_cap = t->cap;
+        t->old_pos = 0;
+        t->slots = slots;
+        t->cap *= 2;
+        t->used = 0;
+        migrate(t, HTAB_MIGRATE);
+        return 0;
+}
+
+int htab_init(htab_t* t, int kind, size_t hint) {
+        size_t cap = HTAB_MIN_CAP;
+        while (cap * 7 / 8 < hint) cap <<= 1;
+        memset(t, 0, sizeof(*t));
+        t->kind = kind;
+        t->slots = (htab_slot_t*)kcalloc(cap, sizeof(htab_slot_t));
+        if (!t->slots) return -1;
+        t->cap = cap;
+        return 0;
+}
+
+void htab_destroy(htab_t* t) {
+        if (t->slots) kfree(t->slots);
+        if (t->old) kfree(t->old);
+        memset(t, 0, sizeof(*t));
+}
+
+static int put(htab_t* t, uint64_t key, uint32_t hash, void* value) {
+        if (!t->slots || !value) return -1;
+        migrate(t, HTAB_MIGRATE);
+        // заполненность не выше 7/8; если расти не удалось, пока есть хоть одна свободная ячейка
+        if ((t->used + 1) * 8 > t->cap * 7 && grow(t) != 0 && t->used + 1 >= t->cap) return -1;
+        htab_slot_t* s = find_in(t, t->slots, t->cap, key, hash);
+        if (s) {
+                s->value = value;
+                return 0;
+        }
+        if (t->old && (s = find_in(t, t->old, t->old_cap, key, hash)) != NULL) {
+                s->dead = 1;
+                t->count--;
+        }
+        insert_new(t, key, hash, value);
+        t->count++;
+        return 0;
+}
+
+static void* get(htab_t* t, uint64_t key, uint32_t hash) {
+        if (!t->slots) return NULL;
+        htab_slot_t* s = find_in(t, t->slots, t->cap, key, hash);
+        if (!s && t->old) s = find_in(t, t->old, t->old_cap, key, hash);
+        return s ? s->value : NULL;
+}
+
+static int del(htab_t* t, uint64_t key, uint32_t hash) {
+        if (!t->slots) return 0;
+        migrate(t, HTAB_MIGRATE);
+        htab_slot_t* s = find_in(t, t->slots, t->cap, key, hash);
+        if (s) {
+                delete_at(t, (size_t)(s - t->slots));
+                t->count--;
+                return 1;
+        }
+        if (t->old && (s = find_in(t, t->old, t->old_cap, key, hash)) != NULL) {
+                s->dead = 1;
+                t->count--;
+                return 1;
+        }
+        return 0;
+}
+
+int htab_put_u64(htab_t* t, uint64_t key, void* value) { return put(t, key, hash_u64(key), value); }
+void* htab_get_u64(htab_t* t, uint64_t key) { return get(t, key, hash_u64(key)); }
+int htab_del_u64(htab_t* t, uint64_t key) { return del(t, key, hash_u64(key)); }
+
+int htab_put_str(htab_t* t, const char* key, void* value) {
+        return put(t, (uint64_t)(uintptr_t)key, hash_str(key), value);
+}
+
+void* htab_get_str(htab_t* t, const char* key) {
+        return get(t, (uint64_t)(uintptr_t)key, hash_str(key));
+}
+
+int htab_del_str(htab_t* t, const char* key) {
+        return del(t, (uint64_t)(uintptr_t)key, hash_str(key));
+}
+
+// ---- самотестирование скорости ----
+
+extern void kprintf(const char* fmt, ...);
+
+static void bench_report(const char* op, size_t n, uint64_t ms) {
+        if (ms == 0) kprintf("htab: %s %lu keys in <1 ms\n", op, (unsigned long)n);
+        else kprintf("htab: %s %lu keys in %lu ms (%lu k/s)\n", op, (unsigned long)n,
+                (unsigned long)ms, (unsigned long)(n / ms));
+}
+
+void htab_benchmark(size_t n) {
+        htab_t t;
+        if (htab_init(&t, HTAB_KEY_U64, 0) != 0) return;
+        // ключи с шагом, чтобы соседние не попадали в соседние ячейки случайно
+        const uint64_t stride = 0x9e3779b97f4a7c15ULL;
+        size_t found = 0;
+        uint64_t t0 = apic_timer_get_time_ms();
+        for (size_t i = 0; i < n; i++) {
+                if (htab_put_u64(&t, i * stride, (void*)(uintptr_t)(i + 1)) != 0) break;
+        }
+        uint64_t t1 = apic_timer_get_time_ms();
+        for (size_t i = 0; i < n; i++) found += htab_get_u64(&t, i * stride) != NULL;
+        uint64_t t2 = apic_timer_get_time_ms();
+        for (size_t i = 0; i < n; i++) found += htab_get_u64(&t, i * stride + 1) != NULL;
+        uint64_t t3 = apic_timer_get_time_ms();
+        for (size_t i = 0; i < n; i++) htab_del_u64(&t, i * stride);
+        uint64_t t4 = apic_timer_get_time_ms();
+        bench_report("insert", n, t1 - t0);
+        bench_report("lookup", n, t2 - t1);
+        bench_report("miss", n, t3 - t2);
+        bench_report("delete", n, t4 - t3);
+        kprintf("htab: found %lu of %lu, %lu left, capacity %lu\n", (unsigned long)found,
+                (unsigned long)n, (unsigned long)htab_count(&t), (unsigned long)t.cap);
+        htab_destroy(&t);
+}
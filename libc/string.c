@@ -1,13 +1,51 @@
 #include <string.h>
 #include <heap.h>
+#include <apic_timer.h>
+#include <fpu.h>
+
+// ---- поиск по словам ----
+// Строковые функции читают по 8 байт с выровненного адреса: выровненное слово
+// никогда не пересекает границу страницы, поэтому чтение за концом строки
+// внутри того же слова безопасно. SSE2 (pcmpeqb) здесь не используется:
+// переключение потоков не сохраняет xmm, а выключать прерывания ради
+// коротких строк дороже выигрыша.
+
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+typedef uint64_t __attribute__((may_alias)) u64_aliased;
+
+// ненулевой, если в слове есть нулевой байт; младший установленный бит
+// точно указывает на первый нулевой байт (ложные срабатывания бывают только выше)
+static inline uint64_t haszero(uint64_t v) {
+        return (v - ONES) & ~v & HIGHS;
+}
+
+// точная маска: старший бит каждого нулевого байта (нужна при поиске с конца)
+static inline uint64_t zeromask(uint64_t v) {
+        uint64_t t = (v & ~HIGHS) + ~HIGHS;
+        return ~(t | v | ~HIGHS);
+}
+
+static inline size_t first_byte(uint64_t mask) {
+        return (size_t)__builtin_ctzll(mask) >> 3;
+}
+
+static inline size_t last_byte(uint64_t mask) {
+        return (size_t)(63 - __builtin_clzll(mask)) >> 3;
+}
 
 // Вычисляет длину строки
 size_t strlen(const char* str) {
-        size_t len = 0;
-        while (str[len] != '\0') {
-                len++;
-        }
-        return len;
+        const char* p = str;
+        while ((uintptr_t)p & 7) {
+                if (*p == '\0') return (size_t)(p - str);
+                p++;
+        }
+        const u64_aliased* w = (const u64_aliased*)p;
+        uint64_t z;
+        while (!(z = haszero(*w))) w++;
+        return (size_t)((const char*)w - str) + first_byte(z);
 }
 
 // Копирует строку
@@ -45,43 +83,51 @@ char* strncpy(char* dest, const char* src, size_t n) {
 
 // Сравнивает две строки
 int strcmp(const char* str1, const char* str2) {
-        while (*str1 != '\0' && *str2 != '\0') {
-                if (*str1 != *str2) {
-                        return (*str1 < *str2) ? -1 : 1;
+        const uint8_t* a = (const uint8_t*)str1;
+        const uint8_t* b = (const uint8_t*)str2;
+        // при одинаковом смещении внутри слова обе строки можно сравнивать словами
+        if ((((uintptr_t)a ^ (uintptr_t)b) & 7) == 0) {
+                while ((uintptr_t)a & 7) {
+                        if (*a != *b || *a == '\0') return *a - *b;
+                        a++;
+                        b++;
+                }
+                uint64_t wa, wb;
+                while ((wa = *(const u64_aliased*)a) == (wb = *(const u64_aliased*)b) && !haszero(wa)) {
+                        a += 8;
+                        b += 8;
                 }
-                str1++;
-                str2++;
         }
-        
-        if (*str1 == '\0' && *str2 == '\0') {
-                return 0;
+        while (*a == *b && *a != '\0') {
+                a++;
+                b++;
         }
-        
-        return (*str1 == '\0') ? -1 : 1;
+        return *a - *b;
 }
 
 // Сравнивает n символов двух строк
 int strncmp(const char* str1, const char* str2, size_t n) {
-        size_t i = 0;
-        
-        while (i < n && *str1 != '\0' && *str2 != '\0') {
-                if (*str1 != *str2) {
-                        return (*str1 < *str2) ? -1 : 1;
+        const uint8_t* a = (const uint8_t*)str1;
+        const uint8_t* b = (const uint8_t*)str2;
+        if ((((uintptr_t)a ^ (uintptr_t)b) & 7) == 0) {
+                while (n && ((uintptr_t)a & 7)) {
+                        if (*a != *b || *a == '\0') return *a - *b;
+                        a++;
+                        b++;
+                        n--;
+                }
+                while (n >= 8) {
+                        uint64_t wa = *(const u64_aliased*)a;
+                        if (wa != *(const u64_aliased*)b || haszero(wa)) break;
+                        a += 8;
+                        b += 8;
+                        n -= 8;
                 }
-                str1++;
-                str2++;
-                i++;
         }
-        
-        if (i == n) {
-                return 0;
+        for (; n; n--, a++, b++) {
+                if (*a != *b || *a == '\0') return *a - *b;
         }
-        
-        if (*str1 == '\0' && *str2 == '\0') {
-                return 0;
-        }
-        
-        return (*str1 == '\0') ? -1 : 1;
+        return 0;
 }
 
 // Объединяет две строки
@@ -116,72 +162,243 @@ char* strncat(char* dest, const char* src, size_t n) {
 
 // Находит первое вхождение символа в строке
 char* strchr(const char* str, int c) {
-        while (*str != '\0') {
-                if (*str == (char)c) {
-                        return (char*)str;
-                }
-                str++;
-        }
-        
-        if (c == '\0') {
-                return (char*)str;
-        }
-        
-        return NULL;
+        uint8_t ch = (uint8_t)c;
+        if (ch == '\0') return (char*)str + strlen(str);
+        const uint8_t* p = (const uint8_t*)str;
+        while ((uintptr_t)p & 7) {
+                if (*p == ch) return (char*)p;
+                if (*p == '\0') return NULL;
+                p++;
+        }
+        uint64_t pattern = ONES * ch;
+        const u64_aliased* w = (const u64_aliased*)p;
+        uint64_t m;
+        while (!(m = haszero(*w) | haszero(*w ^ pattern))) w++;
+        // младший бит объединённой маски точен: это либо искомый символ, либо конец строки
+        p = (const uint8_t*)w + first_byte(m);
+        return *p == ch ? (char*)p : NULL;
 }
 
 // Находит последнее вхождение символа в строке
 char* strrchr(const char* str, int c) {
-        char* last = NULL;
-        
-        while (*str != '\0') {
-                if (*str == (char)c) {
-                        last = (char*)str;
-                }
-                str++;
+        size_t len = strlen(str);
+        if ((uint8_t)c == '\0') return (char*)str + len;
+        return (char*)memrchr(str, c, len);
+}
+
+// Находит первое вхождение байта в n байтах
+void* memchr(const void* ptr, int c, size_t n) {
+        const uint8_t* p = (const uint8_t*)ptr;
+        uint8_t ch = (uint8_t)c;
+        while (n && ((uintptr_t)p & 7)) {
+                if (*p == ch) return (void*)p;
+                p++;
+                n--;
+        }
+        uint64_t pattern = ONES * ch;
+        for (; n >= 8; n -= 8, p += 8) {
+                uint64_t m = haszero(*(const u64_aliased*)p ^ pattern);
+                if (m) return (void*)(p + first_byte(m));
+        }
+        for (; n; n--, p++) {
+                if (*p == ch) return (void*)p;
         }
-        
-        if (c == '\0') {
-                return (char*)str;
+        return NULL;
+}
+
+// Находит последнее вхождение байта в n байтах
+void* memrchr(const void* ptr, int c, size_t n) {
+        const uint8_t* p = (const uint8_t*)ptr + n;
+        uint8_t ch = (uint8_t)c;
+        while (n && ((uintptr_t)p & 7)) {
+                p--;
+                n--;
+                if (*p == ch) return (void*)p;
+        }
+        uint64_t pattern = ONES * ch;
+        for (; n >= 8; n -= 8) {
+                p -= 8;
+                uint64_t m = zeromask(*(const u64_aliased*)p ^ pattern);
+                if (m) return (void*)(p + last_byte(m));
+        }
+        while (n--) {
+                p--;
+                if (*p == ch) return (void*)p;
         }
-        
-        return last;
+        return NULL;
 }
 
 // Находит подстроку в строке
+// Короткий образец ищется через memchr по первому символу, длинный -
+// алгоритмом Хорспула (сдвиг по последнему символу окна).
 char* strstr(const char* haystack, const char* needle) {
-        if (*needle == '\0') {
-                return (char*)haystack;
-        }
-        
-        while (*haystack != '\0') {
-                const char* h = haystack;
-                const char* n = needle;
-                
-                while (*h != '\0' && *n != '\0' && *h == *n) {
+        size_t m = strlen(needle);
+        if (m == 0) return (char*)haystack;
+        if (m == 1) return strchr(haystack, (uint8_t)needle[0]);
+        size_t hlen = strlen(haystack);
+        if (hlen < m) return NULL;
+        const uint8_t* h = (const uint8_t*)haystack;
+        const uint8_t* nd = (const uint8_t*)needle;
+        const uint8_t* end = h + hlen - m;     // последнее возможное начало
+        if (m < 8) {
+                while (h <= end) {
+                        h = (const uint8_t*)memchr(h, nd[0], (size_t)(end - h) + 1);
+                        if (!h) return NULL;
+                        if (memcmp(h + 1, nd + 1, m - 1) == 0) return (char*)h;
                         h++;
-                        n++;
-                }
-                
-                if (*n == '\0') {
-                        return (char*)haystack;
                 }
-                
-                haystack++;
+                return NULL;
+        }
+        uint8_t shift[256];
+        uint8_t maxshift = m > 255 ? 255 : (uint8_t)m;
+        memset(shift, maxshift, sizeof(shift));
+        for (size_t i = m > 255 ? m - 255 : 0; i < m - 1; i++) {
+                shift[nd[i]] = (uint8_t)(m - 1 - i);
+        }
+        uint8_t last = nd[m - 1];
+        while (h <= end) {
+                uint8_t tail = h[m - 1];
+                if (tail == last && memcmp(h, nd, m - 1) == 0) return (char*)h;
+                h += shift[tail];
         }
-        
         return NULL;
 }
 
-// Копирует память
-void* memcpy(void* dest, const void* src, size_t n) {
-        uint8_t* d = (uint8_t*)dest;
-        const uint8_t* s = (const uint8_t*)src;
-        
-        for (size_t i = 0; i < n; i++) {
-                d[i] = s[i];
+// ---- memcpy/memset/memmove/memcmp ----
+// Варианты выбираются один раз при загрузке по CPUID (mem_init); до этого
+// работают rep movsq/stosq, которые есть на любом x86_64.
+// SSE2-вариант использует xmm0-xmm3 в обход ленивого переключения FPU, поэтому
+// обёрнут в kernel_fpu_begin/end: состояние владельца регистров сохраняется,
+// прерывания выключены до конца копирования. Невременные (movnti) копии
+// используют только регистры общего назначения.
+
+#define MEM_NT_MIN   (1024 * 1024)   // с этого размера запись идёт мимо кэша
+
+typedef uint64_t __attribute__((may_alias, aligned(1))) u64_unaligned;
+
+static void copy_movsq(void* d, const void* s, size_t n) {
+        size_t q = n >> 3, r = n & 7;
+        __asm__ volatile("rep movsq" : "+D"(d), "+S"(s), "+c"(q) :: "memory");
+        __asm__ volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(r) :: "memory");
+}
+
+static void copy_erms(void* d, const void* s, size_t n) {
+        __asm__ volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) :: "memory");
+}
+
+static void copy_sse2(void* d, const void* s, size_t n) {
+        size_t blocks = n >> 6;
+        if (blocks) {
+                unsigned long flags;
+                kernel_fpu_begin(&flags);
+                __asm__ volatile(
+                        "1:\n\t"
+                        "movdqu   (%1), %%xmm0\n\t"
+                        "movdqu 16(%1), %%xmm1\n\t"
+                        "movdqu 32(%1), %%xmm2\n\t"
+                        "movdqu 48(%1), %%xmm3\n\t"
+                        "movdqu %%xmm0,   (%0)\n\t"
+                        "movdqu %%xmm1, 16(%0)\n\t"
+                        "movdqu %%xmm2, 32(%0)\n\t"
+                        "movdqu %%xmm3, 48(%0)\n\t"
+                        "add $64, %0\n\t"
+                        "add $64, %1\n\t"
+                        "dec %2\n\t"
+                        "jnz 1b"
+                        : "+r"(d), "+r"(s), "+r"(blocks)
+                        :: "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+                kernel_fpu_end(flags);
+        }
+        copy_movsq(d, s, n & 63);
+}
+
+static void copy_nt(void* d, const void* s, size_t n) {
+        size_t blocks = n >> 5;
+        if (blocks) {
+                uint64_t a, b, c, e;
+                __asm__ volatile(
+                        "1:\n\t"
+                        "mov   (%4), %0\n\t"
+                        "mov  8(%4), %1\n\t"
+                        "mov 16(%4), %2\n\t"
+                        "mov 24(%4), %3\n\t"
+                        "movnti %0,   (%5)\n\t"
+                        "movnti %1,  8(%5)\n\t"
+                        "movnti %2, 16(%5)\n\t"
+                        "movnti %3, 24(%5)\n\t"
+                        "add $32, %4\n\t"
+                        "add $32, %5\n\t"
+                        "dec %6\n\t"
+                        "jnz 1b\n\t"
+                        "sfence"
+                        : "=&r"(a), "=&r"(b), "=&r"(c), "=&r"(e), "+r"(s), "+r"(d), "+r"(blocks)
+                        :: "memory", "cc");
+        }
+        copy_movsq(d, s, n & 31);
+}
+
+static void fill_stosq(void* p, int v, size_t n) {
+        uint64_t pattern = 0x0101010101010101ULL * (uint8_t)v;
+        size_t q = n >> 3, r = n & 7;
+        __asm__ volatile("rep stosq" : "+D"(p), "+c"(q) : "a"(pattern) : "memory");
+        __asm__ volatile("rep stosb" : "+D"(p), "+c"(r) : "a"(pattern) : "memory");
+}
+
+static void fill_erms(void* p, int v, size_t n) {
+        __asm__ volatile("rep stosb" : "+D"(p), "+c"(n) : "a"(v) : "memory");
+}
+
+static void fill_nt(void* p, int v, size_t n) {
+        uint64_t pattern = 0x0101010101010101ULL * (uint8_t)v;
+        size_t blocks = n >> 5;
+        if (blocks) {
+                __asm__ volatile(
+                        "1:\n\t"
+                        "movnti %2,   (%0)\n\t"
+                        "movnti %2,  8(%0)\n\t"
+                        "movnti %2, 16(%0)\n\t"
+                        "movnti %2, 24(%0)\n\t"
+                        "add $32, %0\n\t"
+                        "dec %1\n\t"
+                        "jnz 1b\n\t"
+                        "sfence"
+                        : "+r"(p), "+r"(blocks) : "r"(pattern) : "memory", "cc");
+        }
+        fill_stosq(p, v, n & 31);
+}
+
+static void (*copy_fn)(void*, const void*, size_t) = copy_movsq;
+static void (*fill_fn)(void*, int, size_t) = fill_stosq;
+static int mem_use_nt = 0;
+static const char* mem_variant = "movsq";
+
+static int cpu_has_erms(void) {
+        uint32_t a, b, c, d;
+        __asm__ volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(0), "c"(0));
+        if (a < 7) return 0;
+        __asm__ volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(7), "c"(0));
+        return (b >> 9) & 1;
+}
+
+void mem_init(void) {
+        // SSE2 (и movnti) есть на любом x86_64; ERMS делает rep movsb/stosb самым быстрым путём
+        if (cpu_has_erms()) {
+                copy_fn = copy_erms;
+                fill_fn = fill_erms;
+                mem_variant = "erms";
+        } else {
+                copy_fn = copy_sse2;
+                fill_fn = fill_stosq;
+                mem_variant = "sse2";
         }
-        
+        mem_use_nt = 1;
+}
+
+const char* mem_variant_name(void) { return mem_variant; }
+
+void* memcpy(void* dest, const void* src, size_t n) {
+        if (mem_use_nt && n >= MEM_NT_MIN) copy_nt(dest, src, n);
+        else copy_fn(dest, src, n);
         return dest;
 }
 
@@ -189,30 +406,27 @@ void* memcpy(void* dest, const void* src, size_t n) {
 void* memmove(void* dest, const void* src, size_t n) {
         uint8_t* d = (uint8_t*)dest;
         const uint8_t* s = (const uint8_t*)src;
-        
-        if (d < s) {
-                // Копируем вперед
-                for (size_t i = 0; i < n; i++) {
-                        d[i] = s[i];
-                }
-        } else if (d > s) {
-                // Копируем назад
-                for (size_t i = n; i > 0; i--) {
-                        d[i-1] = s[i-1];
-                }
+        if (d == s || n == 0) return dest;
+        // вперёд безопасно, если приёмник ниже источника или области не пересекаются
+        if (d < s || d >= s + n) return memcpy(dest, src, n);
+        // назад: сначала хвост, не занимающий целого qword, затем qword'ы сверху вниз
+        size_t q = n >> 3, r = n & 7;
+        while (r--) d[q * 8 + r] = s[q * 8 + r];
+        if (q) {
+                uint8_t* dq = d + (q - 1) * 8;
+                const uint8_t* sq = s + (q - 1) * 8;
+                // DF=1 не должен попасть в обработчик прерывания: копируем с cli,
+                // popfq возвращает и IF, и DF=0
+                __asm__ volatile("pushfq; cli; std; rep movsq; popfq"
+                                 : "+D"(dq), "+S"(sq), "+c"(q) :: "memory", "cc");
         }
-        
         return dest;
 }
 
-// Заполняет память значением
+// Заполняет память
 void* memset(void* ptr, int value, size_t n) {
-        uint8_t* p = (uint8_t*)ptr;
-        
-        for (size_t i = 0; i < n; i++) {
-                p[i] = (uint8_t)value;
-        }
-        
+        if (mem_use_nt && n >= MEM_NT_MIN) fill_nt(ptr, value, n);
+        else fill_fn(ptr, value, n);
         return ptr;
 }
 
@@ -220,16 +434,61 @@ void* memset(void* ptr, int value, size_t n) {
 int memcmp(const void* ptr1, const void* ptr2, size_t n) {
         const uint8_t* p1 = (const uint8_t*)ptr1;
         const uint8_t* p2 = (const uint8_t*)ptr2;
-        
-        for (size_t i = 0; i < n; i++) {
+        size_t i = 0;
+        // пропускаем совпадающие qword'ы, первое различие ищем побайтно
+        while (i + 8 <= n && *(const u64_unaligned*)(p1 + i) == *(const u64_unaligned*)(p2 + i)) i += 8;
+        for (; i < n; i++) {
                 if (p1[i] != p2[i]) {
                         return (p1[i] < p2[i]) ? -1 : 1;
                 }
         }
-        
         return 0;
 }
 
+// ---- самотестирование скорости ----
+
+extern void kprintf(const char* fmt, ...);
+
+#define BENCH_BYTES  (1024 * 1024)
+#define BENCH_MS     20
+
+static void bench_one(const char* op, const char* name, void (*copy)(void*, const void*, size_t),
+                      void (*fill)(void*, int, size_t), uint8_t* dst, const uint8_t* src) {
+        uint64_t t0 = apic_timer_get_time_ms(), t1 = t0;
+        // ждём начала тика, чтобы не мерить неполный первый интервал
+        for (uint32_t spin = 0; t1 == t0 && spin < 100000000u; spin++) t1 = apic_timer_get_time_ms();
+        if (t1 == t0) return; // таймер не идёт
+        uint64_t bytes = 0, t;
+        do {
+                if (copy) copy(dst, src, BENCH_BYTES);
+                else fill(dst, 0x5A, BENCH_BYTES);
+                bytes += BENCH_BYTES;
+                t = apic_timer_get_time_ms();
+        } while (t - t1 < BENCH_MS);
+        uint64_t gbps100 = bytes * 100 / ((t - t1) * 1000000ULL);
+        kprintf("mem: %s %s %lu.%lu%lu GB/s\n", op, name, (unsigned long)(gbps100 / 100),
+                (unsigned long)(gbps100 / 10 % 10), (unsigned long)(gbps100 % 10));
+}
+
+void mem_benchmark(void) {
+        uint8_t* src = (uint8_t*)kmalloc(BENCH_BYTES);
+        uint8_t* dst = (uint8_t*)kmalloc(BENCH_BYTES);
+        if (src && dst) {
+                fill_stosq(src, 0xA5, BENCH_BYTES);
+                int erms = cpu_has_erms();
+                bench_one("memcpy", "movsq", copy_movsq, 0, dst, src);
+                if (erms) bench_one("memcpy", "erms", copy_erms, 0, dst, src);
+                bench_one("memcpy", "sse2", copy_sse2, 0, dst, src);
+                bench_one("memcpy", "nt", copy_nt, 0, dst, src);
+                bench_one("memset", "stosq", 0, fill_stosq, dst, src);
+                if (erms) bench_one("memset", "erms", 0, fill_erms, dst, src);
+                bench_one("memset", "nt", 0, fill_nt, dst, src);
+                kprintf("mem: using %s (non-temporal from %u KiB)\n", mem_variant, (unsigned)(MEM_NT_MIN / 1024));
+        }
+        if (src) kfree(src);
+        if (dst) kfree(dst);
+}
+
 // Переворачивает строку
 void reverse(char* str, size_t length) {
         size_t start = 0;
@@ -352,101 +611,111 @@ int trim(char* str) {
         return 1;
 }
 
-// Реализация strtok
-static char* strtok_save = NULL;
+// ---- разбиение на токены ----
+// Набор разделителей хранится битовой картой, поэтому проверка символа не
+// зависит от длины delim.
 
-char* strtok(char* str, const char* delim) {
-        if (!str && !strtok_save) {
-                return NULL;
-        }
-        
-        if (str) {
-                strtok_save = str;
+static void delim_set_init(uint64_t set[4], const char* delim) {
+        set[0] = set[1] = set[2] = set[3] = 0;
+        for (const uint8_t* d = (const uint8_t*)delim; *d; d++) {
+                set[*d >> 6] |= 1ULL << (*d & 63);
         }
-        
-        if (!strtok_save) {
-                return NULL;
-        }
-        
+}
+
+static inline int delim_set_has(const uint64_t set[4], uint8_t c) {
+        return (set[c >> 6] >> (c & 63)) & 1;
+}
+
+// Реентерабельный strtok: всё состояние в *saveptr
+char* strtok_r(char* str, const char* delim, char** saveptr) {
+        char* p = str ? str : *saveptr;
+        if (!p) return NULL;
+        uint64_t set[4];
+        delim_set_init(set, delim);
         // Пропускаем разделители в начале
-        while (*strtok_save && strchr(delim, *strtok_save)) {
-                strtok_save++;
-        }
-        
-        if (*strtok_save == '\0') {
-                strtok_save = NULL;
+        while (*p && delim_set_has(set, (uint8_t)*p)) p++;
+        if (*p == '\0') {
+                *saveptr = NULL;
                 return NULL;
         }
-        
-        char* token_start = strtok_save;
-        
+        char* token_start = p;
         // Ищем следующий разделитель
-        while (*strtok_save && !strchr(delim, *strtok_save)) {
-                strtok_save++;
-        }
-        
-        if (*strtok_save) {
-                *strtok_save = '\0';
-                strtok_save++;
+        while (*p && !delim_set_has(set, (uint8_t)*p)) p++;
+        if (*p) {
+                *p = '\0';
+                *saveptr = p + 1;
         } else {
-                strtok_save = NULL;
+                *saveptr = NULL;
         }
-        
         return token_start;
 }
 
-size_t strnlen(const char* s, size_t maxlen) {
-        size_t i = 0;
-        if (!s) return 0;
-        while (i < maxlen && s[i] != '\0') {
-                i++;
-        }
-        return i;
+// Старый интерфейс с общим состоянием; в новом коде нужен strtok_r
+static char* strtok_save = NULL;
+
+char* strtok(char* str, const char* delim) {
+        return strtok_r(str, delim, &strtok_save);
 }
 
-static int is_delim(char c, const char* delim) {
-        for (const char* d = delim; *d; ++d) if (c == *d) return 1;
-        return 0;
+void str_iter_init_n(str_iter_t* it, const char* str, size_t len, const char* delim) {
+        it->pos = str ? str : "";
+        it->end = it->pos + (str ? len : 0);
+        delim_set_init(it->set, delim ? delim : "");
 }
 
-char** split(const char* str, char* delim, int* n) {
-        if (!str || !delim) {
-                char** empty = (char**)kmalloc(sizeof(char*));
-                if (empty) empty[0] = NULL;
-                if (n) *n = 0;
-                return empty;
+void str_iter_init(str_iter_t* it, const char* str, const char* delim) {
+        str_iter_init_n(it, str, str ? strlen(str) : 0, delim);
+}
+
+int str_iter_next(str_iter_t* it, str_span_t* out) {
+        const char* p = it->pos;
+        const char* end = it->end;
+        while (p < end && delim_set_has(it->set, (uint8_t)*p)) p++;
+        if (p == end) {
+                it->pos = p;
+                return 0;
         }
+        const char* start = p;
+        while (p < end && !delim_set_has(it->set, (uint8_t)*p)) p++;
+        out->ptr = start;
+        out->len = (size_t)(p - start);
+        it->pos = p;
+        return 1;
+}
 
-        // First pass: count tokens
-        size_t count = 0;
-        const char* p = str;
-        while (*p) {
-                while (*p && is_delim(*p, delim)) p++;
-                if (!*p) break;
+// Сравнивает участок строки с C-строкой целиком
+int str_span_eq(str_span_t span, const char* str) {
+        return strncmp(span.ptr, str, span.len) == 0 && str[span.len] == '\0';
+}
+
+size_t strnlen(const char* s, size_t maxlen) {
+        if (!s) return 0;
+        const char* z = (const char*)memchr(s, 0, maxlen);
+        return z ? (size_t)(z - s) : maxlen;
+}
+
+char** split(const char* str, char* delim, int* n) {
+        // Массив указателей и сами токены лежат в одном блоке
+        size_t count = 0, bytes = 0;
+        str_iter_t it;
+        str_span_t tok;
+        str_iter_init(&it, str, delim);
+        while (str_iter_next(&it, &tok)) {
                 count++;
-                while (*p && !is_delim(*p, delim)) p++;
+                bytes += tok.len + 1;
         }
-
-        // Allocate array (NULL-terminated)
-        char** out = (char**)kmalloc((count + 1) * sizeof(char*));
+        char** out = (char**)kmalloc((count + 1) * sizeof(char*) + bytes);
+        if (n) *n = out ? (int)count : 0;
         if (!out) return NULL;
-        out[count] = NULL;
-        if (n) *n = (int)count;
-
-        // Second pass: copy tokens
-        p = str;
+        char* text = (char*)(out + count + 1);
         size_t idx = 0;
-        while (*p) {
-                while (*p && is_delim(*p, delim)) p++;
-                if (!*p) break;
-                const char* start = p;
-                while (*p && !is_delim(*p, delim)) p++;
-                size_t len = (size_t)(p - start);
-                char* token = (char*)kmalloc(len + 1);
-                if (!token) { out[idx] = NULL; return out; }
-                for (size_t i = 0; i < len; i++) token[i] = start[i];
-                token[len] = '\0';
-                out[idx++] = token;
+        str_iter_init(&it, str, delim);
+        while (str_iter_next(&it, &tok)) {
+                memcpy(text, tok.ptr, tok.len);
+                text[tok.len] = '\0';
+                out[idx++] = text;
+                text += tok.len + 1;
         }
+        out[count] = NULL;
         return out;
-}
\ No newline at end of file
+}
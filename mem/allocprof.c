@@ -0,0 +1,214 @@
+#include "../inc/allocprof.h"
+#include "../inc/sysfs.h"
+#include "../inc/apic_timer.h"
+#include <string.h>
+#include <stdint.h>
+
+// Callsites live in a small open-addressing table keyed by return address; a
+// second table maps every live pointer to its site and size so kfree can be
+// charged to the right caller. Both are static: the profiler must not allocate.
+
+static int sort_key = ALLOCPROF_SORT_LIVE;
+
+#ifdef CONFIG_KMALLOC_PROFILE
+
+#define MAX_SITES        256             // power of two
+#define MAX_LIVE         16384           // power of two
+#define OTHER_SITE       MAX_SITES       // catch-all once the site table is full
+
+struct alloc_site {
+    uintptr_t addr;
+    uint64_t  allocs;
+    uint64_t  frees;
+    uint64_t  bytes;                     // total bytes ever allocated
+    size_t    live_bytes;
+    size_t    live_count;
+    uint64_t  first_ms;
+    uint32_t  hist[ALLOCPROF_BUCKETS];
+};
+
+struct live_entry {
+    uintptr_t ptr;                       // 0 = empty slot
+    size_t    size;
+    uint32_t  site;
+};
+
+static struct alloc_site sites[MAX_SITES + 1];
+static struct live_entry live[MAX_LIVE];
+static uint64_t untracked = 0;           // allocations the live table had no room for
+
+static inline unsigned long irq_save(void) {
+    unsigned long flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void irq_restore(unsigned long flags) {
+    __asm__ volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+static inline size_t hash_ptr(uintptr_t p, size_t mask) {
+    return (size_t)(((uint64_t)(p >> 4) * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+static uint32_t site_index(uintptr_t addr) {
+    size_t i = hash_ptr(addr, MAX_SITES - 1);
+    for (size_t n = 0; n < MAX_SITES; n++, i = (i + 1) & (MAX_SITES - 1)) {
+        if (sites[i].addr == addr) return (uint32_t)i;
+        if (sites[i].addr == 0) {
+            sites[i].addr = addr;
+            sites[i].first_ms = apic_timer_get_time_ms();
+            return (uint32_t)i;
+        }
+    }
+    return OTHER_SITE;
+}
+
+static int size_bucket(size_t size) {
+    int b = 0;
+    for (size_t lim = 16; b < ALLOCPROF_BUCKETS - 1 && size > lim; lim <<= 2) b++;
+    return b;
+}
+
+void allocprof_alloc(void* site, void* ptr, size_t size) {
+    if (!ptr) return;
+    unsigned long flags = irq_save();
+    uint32_t s = site_index((uintptr_t)site);
+    struct alloc_site* st = &sites[s];
+    st->allocs++;
+    st->bytes += size;
+    st->live_bytes += size;
+    st->live_count++;
+    st->hist[size_bucket(size)]++;
+    size_t i = hash_ptr((uintptr_t)ptr, MAX_LIVE - 1);
+    size_t n = 0;
+    for (; n < MAX_LIVE && live[i].ptr && live[i].ptr != (uintptr_t)ptr; n++) i = (i + 1) & (MAX_LIVE - 1);
+    if (n < MAX_LIVE) {
+        live[i].ptr = (uintptr_t)ptr;
+        live[i].size = size;
+        live[i].site = s;
+    } else {
+        untracked++;
+    }
+    irq_restore(flags);
+}
+
+void allocprof_free(void* ptr) {
+    if (!ptr) return;
+    unsigned long flags = irq_save();
+    size_t i = hash_ptr((uintptr_t)ptr, MAX_LIVE - 1);
+    for (size_t n = 0; n < MAX_LIVE && live[i].ptr; n++, i = (i + 1) & (MAX_LIVE - 1)) {
+        if (live[i].ptr != (uintptr_t)ptr) continue;
+        struct alloc_site* st = &sites[live[i].site];
+        st->frees++;
+        st->live_bytes -= live[i].size;
+        st->live_count--;
+        // backward-shift deletion keeps probe chains intact without tombstones
+        size_t hole = i;
+        for (size_t j = (i + 1) & (MAX_LIVE - 1); live[j].ptr; j = (j + 1) & (MAX_LIVE - 1)) {
+            size_t home = hash_ptr(live[j].ptr, MAX_LIVE - 1);
+            if (((j - home) & (MAX_LIVE - 1)) >= ((j - hole) & (MAX_LIVE - 1))) {
+                live[hole] = live[j];
+                hole = j;
+            }
+        }
+        live[hole].ptr = 0;
+        break;
+    }
+    irq_restore(flags);
+}
+
+void allocprof_reset(void) {
+    unsigned long flags = irq_save();
+    // keep live pointers so later frees still balance; only the counters restart
+    for (size_t i = 0; i <= MAX_SITES; i++) {
+        sites[i].allocs = sites[i].frees = sites[i].bytes = 0;
+        sites[i].first_ms = apic_timer_get_time_ms();
+        memset(sites[i].hist, 0, sizeof(sites[i].hist));
+    }
+    untracked = 0;
+    irq_restore(flags);
+}
+
+static uint64_t site_rate(const struct alloc_site* st, uint64_t now_ms) {
+    uint64_t dt = now_ms > st->first_ms ? now_ms - st->first_ms : 0;
+    return dt >= 1000 ? st->allocs * 1000 / dt : st->allocs;
+}
+
+static uint64_t site_key(const struct alloc_site* st, int key, uint64_t now_ms) {
+    switch (key) {
+    case ALLOCPROF_SORT_COUNT: return st->allocs;
+    case ALLOCPROF_SORT_BYTES: return st->bytes;
+    case ALLOCPROF_SORT_RATE:  return site_rate(st, now_ms);
+    default:                   return st->live_bytes;
+    }
+}
+
+size_t allocprof_format(char* buf, size_t size, int key, int max_rows) {
+    static uint16_t order[MAX_SITES + 1];
+    size_t n = 0;
+    uint64_t now = apic_timer_get_time_ms();
+    for (size_t i = 0; i <= MAX_SITES; i++)
+        if (sites[i].allocs || sites[i].live_count) order[n++] = (uint16_t)i;
+    // insertion sort, largest first; n is at most a few hundred
+    for (size_t i = 1; i < n; i++) {
+        uint16_t v = order[i];
+        uint64_t kv = site_key(&sites[v], key, now);
+        size_t j = i;
+        while (j > 0 && site_key(&sites[order[j - 1]], key, now) < kv) { order[j] = order[j - 1]; j--; }
+        order[j] = v;
+    }
+    size_t pos = sysfs_emit_at(buf, size, 0,
+        "site allocs frees live_bytes live_n total_bytes rate/s hist(16,64,256,1K,4K,16K,64K,+)\n");
+    for (size_t r = 0; r < n && (max_rows <= 0 || (int)r < max_rows); r++) {
+        const struct alloc_site* st = &sites[order[r]];
+        if (order[r] == OTHER_SITE) pos = sysfs_emit_at(buf, size, pos, "other");
+        else pos = sysfs_emit_at(buf, size, pos, "0x%lx", (unsigned long)st->addr);
+        pos = sysfs_emit_at(buf, size, pos, " %lu %lu %lu %lu %lu %lu %u/%u/%u/%u/%u/%u/%u/%u\n",
+            (unsigned long)st->allocs, (unsigned long)st->frees, (unsigned long)st->live_bytes,
+            (unsigned long)st->live_count, (unsigned long)st->bytes, (unsigned long)site_rate(st, now),
+            st->hist[0], st->hist[1], st->hist[2], st->hist[3],
+            st->hist[4], st->hist[5], st->hist[6], st->hist[7]);
+    }
+    if (untracked) pos = sysfs_emit_at(buf, size, pos, "untracked %lu\n", (unsigned long)untracked);
+    return pos;
+}
+
+#else
+
+void allocprof_reset(void) {}
+
+size_t allocprof_format(char* buf, size_t size, int key, int max_rows) {
+    (void)key; (void)max_rows;
+    return sysfs_emit_at(buf, size, 0, "kmalloc profiling disabled (build with make KMALLOC_PROFILE=1)\n");
+}
+
+#endif
+
+int allocprof_parse_key(const char* s, size_t len) {
+    static const char* names[] = { "live", "count", "bytes", "rate" };
+    while (len && (s[len - 1] == '\n' || s[len - 1] == ' ' || s[len - 1] == '\0')) len--;
+    for (int k = 0; k < 4; k++)
+        if (strlen(names[k]) == len && strncmp(names[k], s, len) == 0) return k;
+    return -1;
+}
+
+static ssize_t allocprof_show(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    return (ssize_t)allocprof_format(buf, size, sort_key, 64);
+}
+
+static ssize_t allocprof_store(const char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (size >= 5 && strncmp(buf, "reset", 5) == 0) { allocprof_reset(); return (ssize_t)size; }
+    int k = allocprof_parse_key(buf, size);
+    if (k < 0) return -1;
+    sort_key = k;
+    return (ssize_t)size;
+}
+
+void allocprof_sysfs_init(void) {
+    struct sysfs_attr attr_sites = { allocprof_show, allocprof_store, NULL };
+    sysfs_create_file("/sys/kernel/mm/alloc_sites", &attr_sites);
+}
@@ -0,0 +1,72 @@
+#include "../inc/arena.h"
+#include "../inc/heap.h"
+
+#define ARENA_ALIGN(x)  (((x) + 15) & ~((size_t)15))
+#define CHUNK_HDR       ARENA_ALIGN(sizeof(arena_chunk_t))
+#define ARENA_HDR       ARENA_ALIGN(sizeof(arena_t))
+
+static inline uint8_t* chunk_data(arena_chunk_t* c) { return (uint8_t*)c + CHUNK_HDR; }
+
+arena_t* arena_create(size_t chunk_size) {
+    chunk_size = ARENA_ALIGN(chunk_size ? chunk_size : 4096);
+    // the arena header and its first chunk share one allocation
+    uint8_t* mem = (uint8_t*)kmalloc(ARENA_HDR + CHUNK_HDR + chunk_size);
+    if (!mem) return 0;
+    arena_t* a = (arena_t*)mem;
+    arena_chunk_t* c = (arena_chunk_t*)(mem + ARENA_HDR);
+    c->prev = 0;
+    c->size = chunk_size;
+    c->used = 0;
+    a->head = a->base = c;
+    a->chunk_size = chunk_size;
+    a->peak = a->live = 0;
+    return a;
+}
+
+void arena_destroy(arena_t* a) {
+    if (!a) return;
+    arena_reset(a);
+    kfree(a);
+}
+
+void* arena_alloc(arena_t* a, size_t size) {
+    if (!a) return 0;
+    size = ARENA_ALIGN(size);
+    arena_chunk_t* c = a->head;
+    if (c->size - c->used < size) {
+        size_t csize = size > a->chunk_size ? size : a->chunk_size;
+        c = (arena_chunk_t*)kmalloc(CHUNK_HDR + csize);
+        if (!c) return 0;
+        c->prev = a->head;
+        c->size = csize;
+        c->used = 0;
+        a->head = c;
+    }
+    void* p = chunk_data(c) + c->used;
+    c->used += size;
+    a->live += size;
+    if (a->live > a->peak) a->peak = a->live;
+    return p;
+}
+
+arena_mark_t arena_mark(const arena_t* a) {
+    arena_mark_t m = { a->head, a->head->used, a->live };
+    return m;
+}
+
+void arena_release(arena_t* a, arena_mark_t m) {
+    if (!a || !m.chunk) return;
+    while (a->head != m.chunk && a->head != a->base) {
+        arena_chunk_t* c = a->head;
+        a->head = c->prev;
+        kfree(c);
+    }
+    a->head->used = m.used;
+    a->live = m.live;
+}
+
+void arena_reset(arena_t* a) {
+    if (!a) return;
+    arena_mark_t m = { a->base, 0, 0 };
+    arena_release(a, m);
+}
@@ -0,0 +1,141 @@
+#include "../inc/dma.h"
+#include "../inc/paging.h"
+#include "../inc/pmm.h"
+#include "../inc/sysfs.h"
+#include <string.h>
+#include <stdint.h>
+
+// Buffers are buddy blocks from the frame allocator, used through the identity
+// map. The two common sizes (4 KiB and 64 KiB) keep a small cache of freed
+// write-back buffers so drivers that recycle descriptors do not go back to the
+// buddy lists each time. A non-default cache attribute is applied by remapping
+// the identity pages of the buffer (large pages there are split) and is undone
+// on free; those buffers are remembered in a small table.
+
+#define POOL_COUNT       2
+#define POOL_CACHE_MAX   16
+#define MAX_ATTR_BUFS    64
+#define CACHE_LINE       64
+
+struct dma_pool {
+    unsigned order;
+    uint64_t cached[POOL_CACHE_MAX];   // physical addresses of free buffers
+    size_t   ncached;
+    uint64_t hits;
+    uint64_t allocs;
+};
+
+struct attr_buf {
+    uint64_t pa;
+    uint64_t size;
+    uint64_t attrs;
+};
+
+static struct dma_pool pools[POOL_COUNT] = { { .order = 0 }, { .order = 4 } };
+static struct attr_buf attr_bufs[MAX_ATTR_BUFS];
+static size_t nattr_bufs = 0;
+static size_t dma_live_bytes = 0;
+static uint64_t dma_failures = 0;
+
+static unsigned size_order(size_t size) {
+    unsigned order = 0;
+    while ((PMM_FRAME_SIZE << order) < size) order++;
+    return order;
+}
+
+static struct dma_pool* pool_for(unsigned order) {
+    for (size_t i = 0; i < POOL_COUNT; i++)
+        if (pools[i].order == order) return &pools[i];
+    return 0;
+}
+
+static void flush_lines(uint64_t pa, uint64_t size) {
+    for (uint64_t a = pa; a < pa + size; a += CACHE_LINE)
+        __asm__ volatile("clflush (%0)" :: "r"((uintptr_t)a) : "memory");
+    __asm__ volatile("mfence" ::: "memory");
+}
+
+// Remap the identity pages of [pa, pa+size) with the given PCD/PWT bits
+static int set_attrs(uint64_t pa, uint64_t size, uint64_t attrs) {
+    return map_range(pa, pa, size, PG_PRESENT | PG_RW | (attrs & (PG_PCD | PG_PWT)));
+}
+
+void* dma_alloc_coherent(size_t size, uint64_t* dma_handle, uint64_t attrs) {
+    if (size == 0 || size > DMA_MAX_SIZE) return 0;
+    attrs &= PG_PCD | PG_PWT;
+    if (attrs && nattr_bufs >= MAX_ATTR_BUFS) { dma_failures++; return 0; }
+    unsigned order = size_order(size);
+    uint64_t bytes = PMM_FRAME_SIZE << order;
+    struct dma_pool* pool = pool_for(order);
+    uint64_t pa = 0;
+    if (pool) {
+        pool->allocs++;
+        if (pool->ncached) {
+            pa = pool->cached[--pool->ncached];
+            pool->hits++;
+            memset((void*)(uintptr_t)pa, 0, bytes);
+        }
+    }
+    if (!pa) pa = pmm_alloc_zeroed(order);
+    if (!pa) { dma_failures++; return 0; }
+    if (attrs) {
+        if (set_attrs(pa, bytes, attrs) != 0) {
+            set_attrs(pa, bytes, DMA_ATTR_WB);
+            pmm_free_pages(pa, order);
+            dma_failures++;
+            return 0;
+        }
+        // the zeroing above went through the cache; nothing may stay behind in it
+        flush_lines(pa, bytes);
+        attr_bufs[nattr_bufs].pa = pa;
+        attr_bufs[nattr_bufs].size = bytes;
+        attr_bufs[nattr_bufs].attrs = attrs;
+        nattr_bufs++;
+    }
+    dma_live_bytes += bytes;
+    if (dma_handle) *dma_handle = pa;
+    return (void*)(uintptr_t)pa;
+}
+
+void dma_free_coherent(void* cpu_addr, size_t size) {
+    if (!cpu_addr || size == 0 || size > DMA_MAX_SIZE) return;
+    uint64_t pa = (uint64_t)(uintptr_t)cpu_addr;
+    unsigned order = size_order(size);
+    uint64_t bytes = PMM_FRAME_SIZE << order;
+    for (size_t i = 0; i < nattr_bufs; i++) {
+        if (attr_bufs[i].pa != pa) continue;
+        set_attrs(pa, bytes, DMA_ATTR_WB);
+        attr_bufs[i] = attr_bufs[--nattr_bufs];
+        break;
+    }
+    dma_live_bytes -= bytes;
+    struct dma_pool* pool = pool_for(order);
+    if (pool && pool->ncached < POOL_CACHE_MAX) {
+        pool->cached[pool->ncached++] = pa;
+        return;
+    }
+    pmm_free_pages(pa, order);
+}
+
+uint64_t dma_virt_to_phys(const void* va) {
+    return virt_to_phys((uint64_t)(uintptr_t)va);
+}
+
+static ssize_t dma_show_stats(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    size_t pos = sysfs_emit_at(buf, size, 0, "live_kb %lu\n", (unsigned long)(dma_live_bytes / 1024));
+    pos = sysfs_emit_at(buf, size, pos, "attr_buffers %lu\n", (unsigned long)nattr_bufs);
+    pos = sysfs_emit_at(buf, size, pos, "failures %lu\n", (unsigned long)dma_failures);
+    for (size_t i = 0; i < POOL_COUNT; i++) {
+        pos = sysfs_emit_at(buf, size, pos, "pool_%luk allocs %lu hits %lu cached %lu\n",
+            (unsigned long)((PMM_FRAME_SIZE << pools[i].order) / 1024), (unsigned long)pools[i].allocs,
+            (unsigned long)pools[i].hits, (unsigned long)pools[i].ncached);
+    }
+    return (ssize_t)pos;
+}
+
+void dma_sysfs_init(void) {
+    struct sysfs_attr attr_dma = { dma_show_stats, NULL, NULL };
+    sysfs_create_file("/sys/kernel/mm/dma", &attr_dma);
+}
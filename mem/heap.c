@@ -1,141 +1,551 @@
 #include "../inc/heap.h"
+#include "../inc/slab.h"
+#include "../inc/pmm.h"
+#include "../inc/paging.h"
+#include "../inc/vm.h"
+#include "../inc/sysfs.h"
+#include "../inc/allocprof.h"
+#include "../inc/dma.h"
 #include <string.h>
 #include <stdint.h>
 
-// Very simple kernel heap: first-fit free list with headers, 16-byte alignment,
-// coalescing on free. No thread safety assumed (callers should serialize).
+// Kernel heap: TLSF (two-level segregated fit) allocator, 16-byte alignment.
+// Free blocks live in size-class lists indexed by a first level (power of two)
+// and a second level (linear split of that power into SL_COUNT ranges); two
+// bitmaps make finding a non-empty list a couple of bit scans, so malloc and
+// free are O(1) regardless of how fragmented the heap is. Every block carries a
+// boundary tag (prev_phys) which makes coalescing with both neighbours O(1).
+// Requests up to SLAB_MAX_SIZE bytes are served by the slab layer (mem/slab.c);
+// TLSF backs large blocks and the slab pages themselves.
+// The heap lives in its own virtual window and grows on demand by mapping 2 MiB
+// frames from the page-frame allocator at its end; a fully free tail above the
+// configurable keep size is unmapped and handed back.
+// No thread safety assumed (callers should serialize).
 
 typedef struct heap_block_header {
-    size_t size;                 // payload size (bytes)
-    struct heap_block_header* next;
-    struct heap_block_header* prev;
-    int    free;
+    struct heap_block_header* prev_phys; // physically previous block (valid if BLOCK_PREV_FREE)
+    size_t size;                         // payload size | BLOCK_* flags in the low bits
+    // the following two only exist while the block is free (they overlay the payload)
+    struct heap_block_header* next_free;
+    struct heap_block_header* prev_free;
 } heap_block_header_t;
 
-#define ALIGN16(x)   (((x) + 15) & ~((size_t)15))
+#define BLOCK_FREE       ((size_t)1)
+#define BLOCK_PREV_FREE  ((size_t)2)
+#define BLOCK_FLAGS      ((size_t)15)
+
+#define HDR_SIZE         (2 * sizeof(void*))    // prev_phys + size; payload follows
+#define MIN_BLOCK        (2 * sizeof(void*))    // room for the free-list links
+#define ALIGN16(x)       (((x) + 15) & ~((size_t)15))
+
+#define SL_LOG2          4
+#define SL_COUNT         (1 << SL_LOG2)
+#define FL_SHIFT         (SL_LOG2 + 4)          // sizes below 1 << FL_SHIFT share fl 0
+#define FL_MAX           32                     // blocks up to 4 GiB
+#define FL_COUNT         (FL_MAX - FL_SHIFT + 1)
+#define SMALL_BLOCK      ((size_t)1 << FL_SHIFT)
+
+#define HEAP_VIRT_BASE   0x0000008000000000ULL  // PML4 slot 1, right above the identity map
+#define HEAP_WINDOW_MAX  (1ULL << 30)           // one page directory worth of 2 MiB pages
+#define HEAP_MAX_CHUNKS  (HEAP_WINDOW_MAX / PAGE_SIZE_2M)
+#define HEAP_INITIAL     (2 * PAGE_SIZE_2M)
+#define HEAP_KEEP_DEFAULT (8 * PAGE_SIZE_2M)    // never trim below this many bytes
 
 static uint8_t* heap_base = 0;
 static size_t   heap_capacity = 0;
-static heap_block_header_t* head = 0;
+static int      heap_ready = 0;
+static int      heap_growable = 0;
+static size_t   heap_keep = HEAP_KEEP_DEFAULT;
+static uint64_t heap_chunks[HEAP_MAX_CHUNKS];  // physical frame behind each mapped 2 MiB page
+
+static uint32_t fl_bitmap = 0;
+static uint32_t sl_bitmap[FL_COUNT];
+static heap_block_header_t* free_lists[FL_COUNT][SL_COUNT];
 
 static size_t heap_used_now = 0;
 static size_t heap_peak     = 0;
 
+// Fragmentation telemetry: plain counters updated on the list operations, so
+// it costs a few adds per call and is always on. The largest free block is
+// only computed when someone reads the stats.
+static size_t   free_bytes_now = 0;
+static size_t   free_blocks_now = 0;
+static uint32_t free_fl_count[FL_COUNT];
+static struct heap_frag_stats frag;
+
 extern uint8_t _end[]; // provided by linker as end of kernel image
 
-void heap_init(uintptr_t heap_start, size_t heap_size) {
-    if (heap_start == 0) {
-        // Default: place heap right after kernel end, align to 16 bytes
-        uintptr_t base = ((uintptr_t)_end + 0xFFF) & ~((uintptr_t)0xFFF);
-        heap_start = base;
+static inline size_t block_size(const heap_block_header_t* b) { return b->size & ~BLOCK_FLAGS; }
+static inline int block_is_free(const heap_block_header_t* b) { return (b->size & BLOCK_FREE) != 0; }
+static inline int block_prev_free(const heap_block_header_t* b) { return (b->size & BLOCK_PREV_FREE) != 0; }
+static inline void* block_payload(heap_block_header_t* b) { return (uint8_t*)b + HDR_SIZE; }
+static inline heap_block_header_t* block_from_payload(const void* p) {
+    return (heap_block_header_t*)((uint8_t*)p - HDR_SIZE);
+}
+static inline heap_block_header_t* block_next(heap_block_header_t* b) {
+    return (heap_block_header_t*)((uint8_t*)b + HDR_SIZE + block_size(b));
+}
+
+static inline void block_set_size(heap_block_header_t* b, size_t size) {
+    b->size = size | (b->size & BLOCK_FLAGS);
+}
+
+// Mark free/used and keep the neighbour's boundary tag in sync
+static void block_mark_free(heap_block_header_t* b) {
+    b->size |= BLOCK_FREE;
+    heap_block_header_t* next = block_next(b);
+    next->prev_phys = b;
+    next->size |= BLOCK_PREV_FREE;
+}
+
+static void block_mark_used(heap_block_header_t* b) {
+    b->size &= ~BLOCK_FREE;
+    block_next(b)->size &= ~BLOCK_PREV_FREE;
+}
+
+static inline int fls_sz(size_t x) { return x ? 63 - __builtin_clzll((unsigned long long)x) : -1; }
+static inline int ffs_u32(uint32_t x) { return x ? __builtin_ctz(x) : -1; }
+
+static void mapping_insert(size_t size, int* fl, int* sl) {
+    if (size < SMALL_BLOCK) {
+        *fl = 0;
+        *sl = (int)(size / (SMALL_BLOCK / SL_COUNT));
+    } else {
+        int f = fls_sz(size);
+        *sl = (int)((size >> (f - SL_LOG2)) ^ (1u << SL_LOG2));
+        *fl = f - (FL_SHIFT - 1);
     }
-    if (heap_size == 0) {
-        // Default size: 16 MiB
-        heap_size = 16ULL * 1024 * 1024;
+}
+
+// Round up to the next list boundary so any block found there is big enough
+static void mapping_search(size_t size, int* fl, int* sl) {
+    if (size >= SMALL_BLOCK) size += ((size_t)1 << (fls_sz(size) - SL_LOG2)) - 1;
+    mapping_insert(size, fl, sl);
+}
+
+static heap_block_header_t* search_suitable(int* fl, int* sl) {
+    if (*fl >= FL_COUNT) return 0;
+    uint32_t sl_map = sl_bitmap[*fl] & (~0u << *sl);
+    if (!sl_map) {
+        uint32_t fl_map = (*fl + 1 < 32) ? (fl_bitmap & (~0u << (*fl + 1))) : 0;
+        if (!fl_map) return 0;
+        *fl = ffs_u32(fl_map);
+        sl_map = sl_bitmap[*fl];
     }
+    *sl = ffs_u32(sl_map);
+    return free_lists[*fl][*sl];
+}
 
-    heap_base = (uint8_t*)heap_start;
-    heap_capacity = heap_size;
+static void remove_free(heap_block_header_t* b, int fl, int sl) {
+    free_bytes_now -= block_size(b);
+    free_blocks_now--;
+    free_fl_count[fl]--;
+    heap_block_header_t* prev = b->prev_free;
+    heap_block_header_t* next = b->next_free;
+    if (next) next->prev_free = prev;
+    if (prev) prev->next_free = next;
+    if (free_lists[fl][sl] == b) {
+        free_lists[fl][sl] = next;
+        if (!next) {
+            sl_bitmap[fl] &= ~(1u << sl);
+            if (!sl_bitmap[fl]) fl_bitmap &= ~(1u << fl);
+        }
+    }
+}
 
-    head = (heap_block_header_t*)heap_base;
-    head->size = heap_capacity - sizeof(heap_block_header_t);
-    head->next = 0;
-    head->prev = 0;
-    head->free = 1;
+static void insert_free(heap_block_header_t* b) {
+    int fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+    heap_block_header_t* cur = free_lists[fl][sl];
+    b->prev_free = 0;
+    b->next_free = cur;
+    if (cur) cur->prev_free = b;
+    free_lists[fl][sl] = b;
+    fl_bitmap |= 1u << fl;
+    sl_bitmap[fl] |= 1u << sl;
+    free_bytes_now += block_size(b);
+    free_blocks_now++;
+    free_fl_count[fl]++;
+}
 
-    heap_used_now = 0;
-    heap_peak = 0;
+static void unlink_free(heap_block_header_t* b) {
+    int fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+    remove_free(b, fl, sl);
 }
 
-static void split_block(heap_block_header_t* blk, size_t size) {
-    size_t remaining = blk->size - size;
-    if (remaining <= sizeof(heap_block_header_t) + 16) return; // too small to split
-    heap_block_header_t* newblk = (heap_block_header_t*)((uint8_t*)blk + sizeof(heap_block_header_t) + size);
-    newblk->size = remaining - sizeof(heap_block_header_t);
-    newblk->free = 1;
-    newblk->next = blk->next;
-    newblk->prev = blk;
-    if (newblk->next) newblk->next->prev = newblk;
-    blk->next = newblk;
-    blk->size = size;
+// Split 'b' so that it has exactly 'size' payload bytes; the remainder becomes a free block
+static heap_block_header_t* split_tail(heap_block_header_t* b, size_t size) {
+    size_t total = block_size(b);
+    if (total < size + HDR_SIZE + MIN_BLOCK) return 0;
+    heap_block_header_t* rest = (heap_block_header_t*)((uint8_t*)b + HDR_SIZE + size);
+    rest->size = total - size - HDR_SIZE;   // flags: used, prev used (fixed below)
+    block_set_size(b, size);
+    rest->prev_phys = b;
+    block_mark_free(rest);
+    return rest;
 }
 
-static void coalesce(heap_block_header_t* blk) {
-    // merge with next
-    if (blk->next && blk->next->free) {
-        blk->size += sizeof(heap_block_header_t) + blk->next->size;
-        blk->next = blk->next->next;
-        if (blk->next) blk->next->prev = blk;
+static heap_block_header_t* merge_prev(heap_block_header_t* b) {
+    if (block_prev_free(b)) {
+        heap_block_header_t* prev = b->prev_phys;
+        unlink_free(prev);
+        block_set_size(prev, block_size(prev) + HDR_SIZE + block_size(b));
+        b = prev;
+        block_next(b)->prev_phys = b;
     }
-    // merge with prev
-    if (blk->prev && blk->prev->free) {
-        blk->prev->size += sizeof(heap_block_header_t) + blk->size;
-        blk->prev->next = blk->next;
-        if (blk->next) blk->next->prev = blk->prev;
-        blk = blk->prev;
+    return b;
+}
+
+static heap_block_header_t* merge_next(heap_block_header_t* b) {
+    heap_block_header_t* next = block_next(b);
+    if (block_is_free(next)) {
+        unlink_free(next);
+        block_set_size(b, block_size(b) + HDR_SIZE + block_size(next));
+        block_next(b)->prev_phys = b;
     }
+    return b;
 }
 
-void* kmalloc(size_t size) {
-    if (!head || size == 0) return 0;
+static void release_block(heap_block_header_t* b) {
+    block_mark_free(b);
+    b = merge_prev(b);
+    b = merge_next(b);
+    insert_free(b);
+}
+
+static inline size_t adjust_size(size_t size) {
     size = ALIGN16(size);
-    heap_block_header_t* cur = head;
-    while (cur) {
-        if (cur->free && cur->size >= size) {
-            split_block(cur, size);
-            cur->free = 0;
-            heap_used_now += cur->size;
-            if (heap_used_now > heap_peak) heap_peak = heap_used_now;
-            return (uint8_t*)cur + sizeof(heap_block_header_t);
+    return size < MIN_BLOCK ? MIN_BLOCK : size;
+}
+
+static void account_alloc(size_t size) {
+    heap_used_now += size;
+    if (heap_used_now > heap_peak) heap_peak = heap_used_now;
+}
+
+static void account_free(size_t size) {
+    if (heap_used_now >= size) heap_used_now -= size; else heap_used_now = 0;
+}
+
+// Take a used block out of a free block found by search_suitable
+static void* prepare_used(heap_block_header_t* b, size_t size) {
+    heap_block_header_t* rest = split_tail(b, size);
+    if (rest) insert_free(rest);
+    block_mark_used(b);
+    account_alloc(block_size(b));
+    return block_payload(b);
+}
+
+static void tlsf_reset(void) {
+    fl_bitmap = 0;
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    memset(free_lists, 0, sizeof(free_lists));
+    memset(free_fl_count, 0, sizeof(free_fl_count));
+    free_bytes_now = free_blocks_now = 0;
+
+    // One big free block followed by a zero-sized used sentinel that stops merging
+    heap_block_header_t* first = (heap_block_header_t*)heap_base;
+    first->prev_phys = 0;
+    first->size = heap_capacity - 2 * HDR_SIZE;
+    heap_block_header_t* sentinel = block_next(first);
+    sentinel->size = 0;
+    sentinel->prev_phys = first;
+    block_mark_free(first);
+    insert_free(first);
+}
+
+static inline heap_block_header_t* heap_sentinel(void) {
+    return (heap_block_header_t*)(heap_base + heap_capacity - HDR_SIZE);
+}
+
+// Map 2 MiB frames at the end of the window so that a free block of at least
+// 'need' payload bytes ends up at the tail. Returns 0 on success.
+static int heap_grow(size_t need) {
+    if (!heap_growable) return -1;
+    // the new block must reach the size class mapping_search will look in
+    if (need >= SMALL_BLOCK) need += ((size_t)1 << (fls_sz(need) - SL_LOG2)) - 1;
+    size_t bytes = (need + 2 * HDR_SIZE + PAGE_SIZE_2M - 1) & ~(PAGE_SIZE_2M - 1);
+    heap_block_header_t* sentinel = heap_sentinel();
+    // a free tail block is merged with the new space, so it counts towards 'need'
+    if (block_prev_free(sentinel)) {
+        size_t tail = block_size(sentinel->prev_phys) + HDR_SIZE;
+        bytes = (need + 2 * HDR_SIZE > tail)
+            ? ((need + 2 * HDR_SIZE - tail + PAGE_SIZE_2M - 1) & ~(PAGE_SIZE_2M - 1))
+            : PAGE_SIZE_2M;
+    }
+    if (heap_capacity + bytes > HEAP_WINDOW_MAX) return -1;
+
+    size_t first = heap_capacity / PAGE_SIZE_2M;
+    size_t n = bytes / PAGE_SIZE_2M;
+    paging_batch_begin();
+    for (size_t i = 0; i < n; i++) {
+        uint64_t pa = pmm_alloc_pages(PMM_MAX_ORDER);
+        if (!pa || map_page_2m((uint64_t)(uintptr_t)heap_base + (first + i) * PAGE_SIZE_2M, pa, PG_PRESENT | PG_RW) != 0) {
+            if (pa) pmm_free_pages(pa, PMM_MAX_ORDER);
+            while (i--) {
+                unmap_page_2m((uint64_t)(uintptr_t)heap_base + (first + i) * PAGE_SIZE_2M);
+                pmm_free_pages(heap_chunks[first + i], PMM_MAX_ORDER);
+            }
+            paging_batch_commit();
+            return -1;
         }
-        cur = cur->next;
+        heap_chunks[first + i] = pa;
     }
-    return 0; // out of memory
+    paging_batch_commit();
+
+    // the old sentinel becomes a free block spanning the new space
+    heap_capacity += bytes;
+    sentinel->size = (bytes - HDR_SIZE) | (sentinel->size & BLOCK_PREV_FREE);
+    heap_block_header_t* end = heap_sentinel();
+    end->size = 0;
+    end->prev_phys = sentinel;
+    block_mark_free(sentinel);
+    insert_free(merge_prev(sentinel));
+    return 0;
 }
 
-void kfree(void* ptr) {
+// Give whole 2 MiB pages of a free tail back, never shrinking below heap_keep
+static void heap_trim(void) {
+    if (!heap_growable || heap_capacity <= heap_keep) return;
+    heap_block_header_t* sentinel = heap_sentinel();
+    if (!block_prev_free(sentinel)) return;
+    heap_block_header_t* tail = sentinel->prev_phys;
+    // the tail block must keep at least a minimal payload, and the new sentinel needs room
+    uintptr_t min_end = (uintptr_t)tail + 2 * HDR_SIZE + MIN_BLOCK;
+    size_t new_cap = ((min_end - (uintptr_t)heap_base) + PAGE_SIZE_2M - 1) & ~(PAGE_SIZE_2M - 1);
+    if (new_cap < heap_keep) new_cap = heap_keep;
+    // keep one page of slack so an alloc/free pair at the boundary does not remap every time
+    if (new_cap + PAGE_SIZE_2M >= heap_capacity) return;
+    new_cap += PAGE_SIZE_2M;
+
+    unlink_free(tail);
+    paging_batch_begin();
+    for (size_t i = new_cap / PAGE_SIZE_2M; i < heap_capacity / PAGE_SIZE_2M; i++)
+        unmap_page_2m((uint64_t)(uintptr_t)heap_base + i * PAGE_SIZE_2M);
+    paging_batch_commit();
+    // frames go back only after no stale translation can reach them
+    for (size_t i = new_cap / PAGE_SIZE_2M; i < heap_capacity / PAGE_SIZE_2M; i++)
+        pmm_free_pages(heap_chunks[i], PMM_MAX_ORDER);
+    heap_capacity = new_cap;
+    heap_block_header_t* end = heap_sentinel();
+    block_set_size(tail, (size_t)((uint8_t*)end - (uint8_t*)tail) - HDR_SIZE);
+    end->size = BLOCK_PREV_FREE;
+    end->prev_phys = tail;
+    insert_free(tail);
+}
+
+void heap_init(uintptr_t heap_start, size_t heap_size) {
+    heap_growable = 0;
+    if (heap_start == 0 && heap_size == 0) {
+        // Default: a growable window backed by 2 MiB frames from the frame allocator
+        heap_base = (uint8_t*)(uintptr_t)HEAP_VIRT_BASE;
+        size_t n = 0;
+        for (; n < HEAP_INITIAL / PAGE_SIZE_2M; n++) {
+            uint64_t pa = pmm_alloc_pages(PMM_MAX_ORDER);
+            if (!pa) break;
+            if (map_page_2m(HEAP_VIRT_BASE + n * PAGE_SIZE_2M, pa, PG_PRESENT | PG_RW) != 0) {
+                pmm_free_pages(pa, PMM_MAX_ORDER);
+                break;
+            }
+            heap_chunks[n] = pa;
+        }
+        if (n == HEAP_INITIAL / PAGE_SIZE_2M) {
+            heap_capacity = n * PAGE_SIZE_2M;
+            heap_growable = 1;
+        } else {
+            while (n--) {
+                unmap_page_2m(HEAP_VIRT_BASE + n * PAGE_SIZE_2M);
+                pmm_free_pages(heap_chunks[n], PMM_MAX_ORDER);
+            }
+        }
+    }
+    if (!heap_growable) {
+        if (heap_start == 0) {
+            // No frame allocator: place heap right after kernel end, align to 4 KiB
+            uintptr_t base = ((uintptr_t)_end + 0xFFF) & ~((uintptr_t)0xFFF);
+            heap_start = base;
+        }
+        if (heap_size == 0) {
+            // Default size: 16 MiB
+            heap_size = 16ULL * 1024 * 1024;
+        }
+        heap_base = (uint8_t*)heap_start;
+        heap_capacity = heap_size & ~((size_t)15);
+        // the window is claimed directly, keep the frame allocator away from it
+        pmm_reserve_range(heap_start, heap_capacity);
+    }
+
+    tlsf_reset();
+
+    heap_used_now = 0;
+    heap_peak = 0;
+    heap_ready = 1;
+
+    // slab pages may come from anywhere the heap can ever grow to
+    slab_init((uintptr_t)heap_base, heap_growable ? HEAP_WINDOW_MAX : heap_capacity);
+}
+
+// Find a free block of at least 'size' bytes, growing the heap if needed, and
+// take it off its list. Search length counts the steps taken: 1 when the
+// rounded-up list (or a larger one of the same power) had a block, 2 when a
+// larger power of two had to be used, 3 when the heap had to grow.
+static heap_block_header_t* find_free(size_t size) {
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+    int want_fl = fl;
+    heap_block_header_t* b = search_suitable(&fl, &sl);
+    unsigned steps = 1;
+    if (b && fl != want_fl) steps = 2;
+    if (!b) {
+        steps = 3;
+        if (heap_grow(size) == 0) {
+            mapping_search(size, &fl, &sl);
+            b = search_suitable(&fl, &sl);
+        }
+    }
+    frag.searches++;
+    frag.search_steps += steps;
+    if (steps == 3) frag.grows++;
+    if (!b) { frag.failures++; return 0; } // out of memory
+    remove_free(b, fl, sl);
+    return b;
+}
+
+static void* heap_alloc(size_t size) {
+    size = adjust_size(size);
+    heap_block_header_t* b = find_free(size);
+    return b ? prepare_used(b, size) : 0;
+}
+
+static void* kmalloc_impl(size_t size) {
+    if (!heap_ready || size == 0) return 0;
+    if (size <= SLAB_MAX_SIZE) {
+        void* p = slab_alloc(size);
+        if (p) return p;
+    }
+    return heap_alloc(size);
+}
+
+static void* kmalloc_aligned_impl(size_t size, size_t align) {
+    if (!heap_ready || size == 0) return 0;
+    if (align <= 16) return heap_alloc(size);
+    if (align & (align - 1)) return 0;
+    size = adjust_size(size);
+    // over-allocate so that a gap large enough to be a free block always fits in front
+    size_t gap_min = HDR_SIZE + MIN_BLOCK;
+    size_t request = adjust_size(size + align + gap_min);
+    heap_block_header_t* b = find_free(request);
+    if (!b) return 0;
+
+    uintptr_t payload = (uintptr_t)block_payload(b);
+    uintptr_t aligned = (payload + align - 1) & ~((uintptr_t)align - 1);
+    if (aligned != payload && aligned - payload < gap_min) aligned += align;
+    size_t gap = aligned - payload;
+    if (gap) {
+        // split the gap off as its own free block
+        heap_block_header_t* ab = (heap_block_header_t*)(aligned - HDR_SIZE);
+        ab->size = block_size(b) - gap;
+        block_set_size(b, gap - HDR_SIZE);
+        ab->prev_phys = b;
+        block_mark_free(b);   // also flags ab as having a free predecessor
+        block_mark_free(ab);
+        b = merge_prev(b);
+        insert_free(b);
+        b = ab;
+    }
+    return prepare_used(b, size);
+}
+
+static void kfree_impl(void* ptr) {
     if (!ptr) return;
-    heap_block_header_t* blk = (heap_block_header_t*)((uint8_t*)ptr - sizeof(heap_block_header_t));
-    blk->free = 1;
-    if (heap_used_now >= blk->size) heap_used_now -= blk->size; else heap_used_now = 0;
-    coalesce(blk);
+    if (slab_owns(ptr)) { slab_free(ptr); return; }
+    heap_block_header_t* b = block_from_payload(ptr);
+    if (block_is_free(b)) return; // double free
+    account_free(block_size(b));
+    release_block(b);
+    heap_trim();
 }
 
-void* krealloc(void* ptr, size_t new_size) {
-    if (!ptr) return kmalloc(new_size);
-    if (new_size == 0) { kfree(ptr); return 0; }
-    heap_block_header_t* blk = (heap_block_header_t*)((uint8_t*)ptr - sizeof(heap_block_header_t));
-    size_t old_size = blk->size;
-    new_size = ALIGN16(new_size);
-    if (new_size <= old_size) {
-        split_block(blk, new_size);
-        size_t diff = old_size - new_size;
-        if (heap_used_now >= diff) heap_used_now -= diff; else heap_used_now = 0;
+static void* krealloc_impl(void* ptr, size_t new_size) {
+    if (!ptr) return kmalloc_impl(new_size);
+    if (new_size == 0) { kfree_impl(ptr); return 0; }
+    if (slab_owns(ptr)) {
+        size_t old_size = slab_obj_size(ptr);
+        if (new_size <= old_size) { frag.realloc_shrink++; return ptr; }
+        void* n = kmalloc_impl(new_size);
+        if (!n) return 0;
+        memcpy(n, ptr, old_size);
+        slab_free(ptr);
+        frag.realloc_moved++;
+        return n;
+    }
+    heap_block_header_t* b = block_from_payload(ptr);
+    size_t old_size = block_size(b);
+    size_t want = adjust_size(new_size);
+    if (want <= old_size) {
+        heap_block_header_t* rest = split_tail(b, want);
+        if (rest) {
+            account_free(old_size - block_size(b));
+            rest = merge_next(rest);
+            insert_free(rest);
+        }
+        frag.realloc_shrink++;
         return ptr;
     }
-    // try to grow in place if next is free and large enough
-    if (blk->next && blk->next->free && old_size + sizeof(heap_block_header_t) + blk->next->size >= new_size) {
-        blk->size += sizeof(heap_block_header_t) + blk->next->size;
-        blk->next = blk->next->next;
-        if (blk->next) blk->next->prev = blk;
-        split_block(blk, new_size);
-        size_t diff = new_size - old_size;
-        heap_used_now += diff;
-        if (heap_used_now > heap_peak) heap_peak = heap_used_now;
+    // try to grow in place by absorbing a free physical successor
+    heap_block_header_t* next = block_next(b);
+    if (block_is_free(next) && old_size + HDR_SIZE + block_size(next) >= want) {
+        unlink_free(next);
+        block_set_size(b, old_size + HDR_SIZE + block_size(next));
+        block_mark_used(b);
+        heap_block_header_t* rest = split_tail(b, want);
+        if (rest) insert_free(rest);
+        account_alloc(block_size(b) - old_size);
+        frag.realloc_inplace++;
         return ptr;
     }
-    void* n = kmalloc(new_size);
+    void* n = kmalloc_impl(new_size);
     if (!n) return 0;
-    size_t to_copy = old_size < new_size ? old_size : new_size;
-    memcpy(n, ptr, to_copy);
-    kfree(ptr);
+    memcpy(n, ptr, old_size);
+    kfree_impl(ptr);
+    frag.realloc_moved++;
+    return n;
+}
+
+// The public entry points only add profiler hooks around the *_impl versions;
+// they must not call each other so that each records its own caller.
+void* kmalloc(size_t size) {
+    void* p = kmalloc_impl(size);
+    ALLOCPROF_ALLOC(p, size);
+    return p;
+}
+
+void* kmalloc_aligned(size_t size, size_t align) {
+    void* p = kmalloc_aligned_impl(size, align);
+    ALLOCPROF_ALLOC(p, size);
+    return p;
+}
+
+void kfree(void* ptr) {
+    ALLOCPROF_FREE(ptr);
+    kfree_impl(ptr);
+}
+
+void* krealloc(void* ptr, size_t new_size) {
+    void* n = krealloc_impl(ptr, new_size);
+    if (n || new_size == 0) {
+        ALLOCPROF_FREE(ptr);
+        ALLOCPROF_ALLOC(n, new_size);
+    }
     return n;
 }
 
 void* kcalloc(size_t num, size_t size) {
     size_t total = num * size;
-    void* p = kmalloc(total);
+    void* p = kmalloc_impl(total);
     if (p) memset(p, 0, total);
+    ALLOCPROF_ALLOC(p, total);
     return p;
 }
 
@@ -143,4 +553,98 @@ size_t heap_total_bytes(void) { return heap_capacity; }
 size_t heap_used_bytes(void)  { return heap_used_now; }
 size_t heap_peak_bytes(void)  { return heap_peak; }
 
+static size_t largest_free(void) {
+    if (!fl_bitmap) return 0;
+    int fl = fls_sz(fl_bitmap);
+    int sl = fls_sz(sl_bitmap[fl]);
+    size_t max = 0;
+    // lists are unordered, but the top one only spans 1/SL_COUNT of a power of two
+    for (heap_block_header_t* b = free_lists[fl][sl]; b; b = b->next_free)
+        if (block_size(b) > max) max = block_size(b);
+    return max;
+}
+
+void heap_get_frag_stats(struct heap_frag_stats* out) {
+    if (!out) return;
+    *out = frag;
+    out->free_bytes = free_bytes_now;
+    out->free_blocks = free_blocks_now;
+    out->largest_free = largest_free();
+}
+
+static ssize_t heap_show_stat(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    size_t pos = sysfs_emit_at(buf, size, 0, "total %lu\n", (unsigned long)heap_capacity);
+    pos = sysfs_emit_at(buf, size, pos, "used %lu\n", (unsigned long)heap_used_now);
+    pos = sysfs_emit_at(buf, size, pos, "peak %lu\n", (unsigned long)heap_peak);
+    pos = sysfs_emit_at(buf, size, pos, "max %lu\n",
+        (unsigned long)(heap_growable ? HEAP_WINDOW_MAX : heap_capacity));
+    return (ssize_t)pos;
+}
+
+static ssize_t heap_show_frag(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    struct heap_frag_stats st;
+    heap_get_frag_stats(&st);
+    // external fragmentation: share of free memory not usable by the largest request
+    unsigned long pct = st.free_bytes ? (unsigned long)(100 - st.largest_free * 100 / st.free_bytes) : 0;
+    unsigned long avg100 = st.searches ? (unsigned long)(st.search_steps * 100 / st.searches) : 0;
+    size_t pos = sysfs_emit_at(buf, size, 0, "free_bytes %lu\n", (unsigned long)st.free_bytes);
+    pos = sysfs_emit_at(buf, size, pos, "free_blocks %lu\n", (unsigned long)st.free_blocks);
+    pos = sysfs_emit_at(buf, size, pos, "largest_free %lu\n", (unsigned long)st.largest_free);
+    pos = sysfs_emit_at(buf, size, pos, "fragmentation_pct %lu\n", pct);
+    pos = sysfs_emit_at(buf, size, pos, "searches %lu\n", (unsigned long)st.searches);
+    pos = sysfs_emit_at(buf, size, pos, "search_len_avg %lu.%lu%lu\n", avg100 / 100, (avg100 / 10) % 10, avg100 % 10);
+    pos = sysfs_emit_at(buf, size, pos, "grows %lu\n", (unsigned long)st.grows);
+    pos = sysfs_emit_at(buf, size, pos, "failures %lu\n", (unsigned long)st.failures);
+    pos = sysfs_emit_at(buf, size, pos, "realloc_inplace %lu\n", (unsigned long)st.realloc_inplace);
+    pos = sysfs_emit_at(buf, size, pos, "realloc_shrink %lu\n", (unsigned long)st.realloc_shrink);
+    pos = sysfs_emit_at(buf, size, pos, "realloc_moved %lu\n", (unsigned long)st.realloc_moved);
+    // free blocks per power-of-two class, labelled by the class' lower bound
+    for (int fl = 0; fl < FL_COUNT; fl++) {
+        if (!free_fl_count[fl]) continue;
+        size_t lo = fl ? (size_t)1 << (fl + FL_SHIFT - 1) : 0;
+        pos = sysfs_emit_at(buf, size, pos, "free_ge_%lu %u\n", (unsigned long)lo, free_fl_count[fl]);
+    }
+    return (ssize_t)pos;
+}
+
+static ssize_t heap_show_keep(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    return (ssize_t)sysfs_emit_at(buf, size, 0, "%lu\n", (unsigned long)(heap_keep / 1024));
+}
+
+// Accepts a size in KiB; rounded up to whole 2 MiB pages
+static ssize_t heap_store_keep(const char *buf, size_t size, void *priv) {
+    (void)priv;
+    unsigned long kb;
+    if (sysfs_parse_ulong(buf, size, &kb) != 0) return -1;
+    heap_set_keep((size_t)kb * 1024);
+    return (ssize_t)size;
+}
 
+void heap_set_keep(size_t bytes) {
+    bytes = (bytes + PAGE_SIZE_2M - 1) & ~(PAGE_SIZE_2M - 1);
+    if (bytes < HEAP_INITIAL) bytes = HEAP_INITIAL;
+    heap_keep = bytes;
+    heap_trim();
+}
+
+void mm_sysfs_init(void) {
+    sysfs_mkdir("/sys/kernel/mm");
+    struct sysfs_attr attr_heap = { heap_show_stat, NULL, NULL };
+    sysfs_create_file("/sys/kernel/mm/heap", &attr_heap);
+    struct sysfs_attr attr_frag = { heap_show_frag, NULL, NULL };
+    sysfs_create_file("/sys/kernel/mm/fragmentation", &attr_frag);
+    struct sysfs_attr attr_keep = { heap_show_keep, heap_store_keep, NULL };
+    sysfs_create_file("/sys/kernel/mm/heap_keep_kb", &attr_keep);
+    slab_sysfs_init();
+    pmm_sysfs_init();
+    paging_sysfs_init();
+    vm_sysfs_init();
+    dma_sysfs_init();
+    allocprof_sysfs_init();
+}
@@ -1,18 +1,52 @@
+// map_page_4k is reached from #PF; keep gcc from vectorising into xmm
+#pragma GCC target("general-regs-only")
+
 #include <paging.h>
+#include <pmm.h>
+#include <sysfs.h>
 
 // Bootstrap page tables are defined in boot/multiboot.asm
-// We import only L4. L3 identity maps first 4GiB using 1GiB pages already.
+// L4[0] -> L3 whose first four entries point to PDs identity mapping 0..4GiB with 2MiB pages.
 extern uint64_t page_table_l4[];   // 4KiB aligned, 512 entries
+extern uint8_t _end[];
+
+#define PTE_ADDR_MASK    0x000FFFFFFFFFF000ULL
+// flags a caller may pass through to a leaf entry (NX is not enabled in EFER)
+#define LEAF_FLAGS       (PG_US | PG_PWT | PG_PCD | PG_GLOBAL)
+// flags copied from a large page into the entries it is split into
+#define SPLIT_FLAGS      (PG_PRESENT | PG_RW | PG_US | PG_PWT | PG_PCD | PG_ACCESSED | PG_DIRTY | PG_GLOBAL)
+
+// Page tables come from the frame allocator (identity mapped, so the physical
+// address is usable as a pointer). A small static pool covers the time before
+// pmm_init or a machine without a memory map.
+#define BOOT_POOL_TABLES 16
+static uint64_t boot_pool[BOOT_POOL_TABLES][PT_ENTRIES] __attribute__((aligned(4096)));
+static size_t   boot_pool_used = 0;
+static size_t   tables_in_use = 0;
+static int      has_1g_pages = -1;
 
-// Simple page-table allocator for creating new PDPT/PD tables for 2MiB mappings
 static uint64_t* next_free_table(void) {
-    static uint64_t pool[16][PT_ENTRIES] __attribute__((aligned(4096)));
-    static size_t used = 0;
-    if (used >= 16) return 0;
-    for (size_t i = 0; i < PT_ENTRIES; i++) pool[used][i] = 0;
-    return pool[used++];
+    uint64_t* t = (uint64_t*)(uintptr_t)pmm_alloc_zeroed(0);
+    if (!t) {
+        if (boot_pool_used >= BOOT_POOL_TABLES) return 0;
+        t = boot_pool[boot_pool_used++];
+        for (size_t i = 0; i < PT_ENTRIES; i++) t[i] = 0;
+    }
+    tables_in_use++;
+    return t;
+}
+
+static void free_table(uint64_t* t) {
+    uintptr_t a = (uintptr_t)t;
+    // tables inside the kernel image (bootstrap tables, boot pool) are never recycled
+    if (a >= (uintptr_t)boot_pool && a < (uintptr_t)boot_pool + sizeof(boot_pool)) { tables_in_use--; return; }
+    if (a < (uintptr_t)_end) return;
+    tables_in_use--;
+    pmm_free_page((uint64_t)a);
 }
 
+static inline uint64_t* entry_table(uint64_t e) { return (uint64_t*)(uintptr_t)(e & PTE_ADDR_MASK); }
+
 static inline uint64_t read_cr3(void) {
     uint64_t v; __asm__ volatile("mov %%cr3, %0" : "=r"(v)); return v;
 }
@@ -22,51 +56,397 @@ static inline void write_cr3(uint64_t v) {
 
 void invlpg(void* va) { __asm__ volatile("invlpg (%0)" :: "r"(va) : "memory"); }
 
+// TLB invalidation. Outside a batch every change is flushed right away with
+// invlpg. Inside paging_batch_begin/commit the addresses are queued and flushed
+// at commit; above tlb_flush_threshold pages a single full flush is cheaper
+// (CR3 reload, or a CR4.PGE toggle when a global translation changed).
+#define TLB_BATCH_MAX    64
+#define CR4_PGE          (1ULL << 7)
+
+static uint64_t tlb_queue[TLB_BATCH_MAX];
+static size_t   tlb_queued = 0;       // may exceed TLB_BATCH_MAX; then only a full flush works
+static int      tlb_batch_depth = 0;
+static int      tlb_batch_global = 0;
+static size_t   tlb_flush_threshold = 32;
+static struct paging_tlb_stats tlb_stats;
+
+static inline uint64_t read_cr4(void) {
+    uint64_t v; __asm__ volatile("mov %%cr4, %0" : "=r"(v)); return v;
+}
+static inline void write_cr4(uint64_t v) {
+    __asm__ volatile("mov %0, %%cr4" :: "r"(v) : "memory");
+}
+
+static void tlb_flush_all(int global) {
+    if (global) {
+        uint64_t cr4 = read_cr4();
+        if (cr4 & CR4_PGE) {
+            write_cr4(cr4 & ~CR4_PGE);
+            write_cr4(cr4);
+            tlb_stats.full_flushes++;
+            return;
+        }
+    }
+    write_cr3(read_cr3());
+    tlb_stats.full_flushes++;
+}
+
+// 'old' is the entry that was replaced; its G bit decides how hard to flush
+static void tlb_flush_page(uint64_t va, uint64_t old) {
+    if (tlb_batch_depth == 0) {
+        invlpg((void*)va);
+        tlb_stats.invlpg++;
+        return;
+    }
+    if (old & PG_GLOBAL) tlb_batch_global = 1;
+    if (tlb_queued < TLB_BATCH_MAX) tlb_queue[tlb_queued] = va;
+    tlb_queued++;
+    tlb_stats.deferred++;
+}
+
+// A table entry was replaced: the translations cached for everything under it
+// span far more than va, so only a full flush drops them all
+static void tlb_flush_tree(void) {
+    if (tlb_batch_depth == 0) {
+        tlb_flush_all(1);
+        return;
+    }
+    tlb_batch_global = 1;
+    tlb_queued = TLB_BATCH_MAX + 1;
+    tlb_stats.deferred++;
+}
+
+static void tlb_flush_queued(void) {
+    if (tlb_queued == 0) return;
+    tlb_stats.batches++;
+    if (tlb_queued > tlb_flush_threshold || tlb_queued > TLB_BATCH_MAX) {
+        tlb_flush_all(tlb_batch_global);
+    } else {
+        for (size_t i = 0; i < tlb_queued; i++) invlpg((void*)tlb_queue[i]);
+        tlb_stats.invlpg += tlb_queued;
+    }
+    tlb_queued = 0;
+    tlb_batch_global = 0;
+}
+
+// Frames that stop being page tables or mapped memory are handed back only
+// once no TLB or paging-structure cache entry can reach them: right after the
+// flush outside a batch, at commit inside one. release == NULL: a page table.
+#define FREE_BATCH_MAX   64
+
+struct deferred_free {
+    uint64_t pa;
+    uint64_t bytes;
+    void (*release)(uint64_t pa, uint64_t bytes);
+};
+
+static struct deferred_free free_queue[FREE_BATCH_MAX];
+static size_t free_queued = 0;
+
+static void free_now(const struct deferred_free* f) {
+    if (f->release) f->release(f->pa, f->bytes);
+    else free_table((uint64_t*)(uintptr_t)f->pa);
+}
+
+static void free_queued_frames(void) {
+    // release() may map or unmap again and queue more: take entries off first
+    while (free_queued) {
+        struct deferred_free f = free_queue[--free_queued];
+        free_now(&f);
+    }
+}
+
+// Call after the tlb_flush_page/tlb_flush_tree that unlinked the frame
+static void free_after_flush(uint64_t pa, uint64_t bytes, void (*release)(uint64_t, uint64_t)) {
+    struct deferred_free f = { pa, bytes, release };
+    if (tlb_batch_depth == 0) {
+        free_now(&f);
+        return;
+    }
+    if (free_queued == FREE_BATCH_MAX) {
+        // queue full: flush what the batch has so far, then the frames are safe
+        tlb_flush_queued();
+        free_queued_frames();
+    }
+    free_queue[free_queued++] = f;
+}
+
+void paging_batch_begin(void) {
+    tlb_batch_depth++;
+}
+
+void paging_batch_commit(void) {
+    if (tlb_batch_depth == 0 || --tlb_batch_depth > 0) return;
+    tlb_flush_queued();
+    free_queued_frames();
+}
+
+void paging_set_flush_threshold(size_t pages) {
+    tlb_flush_threshold = pages > TLB_BATCH_MAX ? TLB_BATCH_MAX : pages;
+}
+
+void paging_get_tlb_stats(struct paging_tlb_stats* out) {
+    if (out) *out = tlb_stats;
+}
+
 void paging_init(void) {
     // Ensure CR3 is loaded with our L4 base (it already is after bootstrap)
     (void)read_cr3();
+    uint32_t a, b, c, d;
+    __asm__ volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(0x80000000), "c"(0));
+    has_1g_pages = 0;
+    if (a >= 0x80000001) {
+        __asm__ volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(0x80000001), "c"(0));
+        has_1g_pages = (d >> 26) & 1;   // Page1GB
+    }
 }
 
-int map_page_2m(uint64_t va, uint64_t pa, uint64_t flags) {
-    // Extract indices
-    uint64_t l4i = (va >> 39) & 0x1FF;
-    uint64_t l3i = (va >> 30) & 0x1FF;
-    uint64_t l2i = (va >> 21) & 0x1FF;
+int paging_has_1g_pages(void) { return has_1g_pages > 0; }
+size_t paging_tables_in_use(void) { return tables_in_use; }
 
-    uint64_t* l4 = (uint64_t*)((uint64_t)page_table_l4);
-    if (!(l4[l4i] & PG_PRESENT)) {
-        uint64_t* new_l3 = next_free_table();
-        if (!new_l3) return -1;
-        l4[l4i] = ((uint64_t)new_l3) | PG_PRESENT | PG_RW;
+// Free a page table and every lower-level table it references
+// (the tree must already be unlinked and flushed, see free_after_flush)
+static void free_table_tree(uint64_t* t, int level) {
+    if (level > 1) {
+        for (size_t i = 0; i < PT_ENTRIES; i++)
+            if ((t[i] & PG_PRESENT) && !(t[i] & PG_PS_2M)) free_table_tree(entry_table(t[i]), level - 1);
     }
+    free_after_flush((uint64_t)(uintptr_t)t, PAGE_SIZE_4K, 0);
+}
 
-    uint64_t* l3 = (uint64_t*)(l4[l4i] & ~0xFFFULL);
-    if (!(l3[l3i] & PG_PRESENT)) {
-        uint64_t* new_l2 = next_free_table();
-        if (!new_l2) return -2;
-        l3[l3i] = ((uint64_t)new_l2) | PG_PRESENT | PG_RW;
+// Replace a large page entry by a table of 512 entries one level down that map
+// the same memory with the same attributes
+static int split_large(uint64_t* entry, uint64_t step, int to_leaf) {
+    uint64_t* t = next_free_table();
+    if (!t) return -1;
+    uint64_t base = *entry & PTE_ADDR_MASK & ~(step * PT_ENTRIES - 1);
+    uint64_t flags = *entry & SPLIT_FLAGS;
+    for (size_t i = 0; i < PT_ENTRIES; i++)
+        t[i] = (base + i * step) | flags | (to_leaf ? 0 : PG_PS_2M);
+    *entry = ((uint64_t)(uintptr_t)t) | PG_PRESENT | PG_RW | (*entry & PG_US);
+    return 0;
+}
+
+#define WALK_LOOKUP  0   // fail on a missing table or a large page
+#define WALK_SPLIT   1   // split large pages, fail on a missing table
+#define WALK_CREATE  2   // split large pages and create missing tables
+
+// Return the table at 'level' (3 = PDPT, 2 = PD, 1 = PT) that covers va
+static uint64_t* walk(uint64_t va, int level, int mode, uint64_t flags) {
+    uint64_t* t = (uint64_t*)((uint64_t)page_table_l4);
+    for (int l = 4; l > level; l--) {
+        uint64_t* e = &t[(va >> (12 + 9 * (l - 1))) & 0x1FF];
+        if (!(*e & PG_PRESENT)) {
+            if (mode != WALK_CREATE) return 0;
+            uint64_t* n = next_free_table();
+            if (!n) return 0;
+            *e = ((uint64_t)(uintptr_t)n) | PG_PRESENT | PG_RW | (flags & PG_US);
+        } else if (*e & PG_PS_2M) {
+            // large page in the way (1GiB at L3, 2MiB at L2)
+            if (mode == WALK_LOOKUP) return 0;
+            uint64_t old = *e;
+            if (split_large(e, 1ULL << (12 + 9 * (l - 2)), l == 2) != 0) return 0;
+            tlb_flush_page(va, old);
+        } else if (flags & PG_US) {
+            *e |= PG_US;
+        }
+        t = entry_table(*e);
     }
+    return t;
+}
 
-    uint64_t* l2 = (uint64_t*)(l3[l3i] & ~0xFFFULL);
+int map_page_4k(uint64_t va, uint64_t pa, uint64_t flags) {
+    uint64_t* pt = walk(va, 1, WALK_CREATE, flags);
+    if (!pt) return -1;
+    uint64_t* e = &pt[(va >> 12) & 0x1FF];
+    uint64_t old = *e;
+    *e = (pa & PTE_ADDR_MASK) | PG_PRESENT | PG_RW | (flags & LEAF_FLAGS);
+    if (old & PG_PRESENT) tlb_flush_page(va, old);
+    return 0;
+}
+
+int map_page_2m(uint64_t va, uint64_t pa, uint64_t flags) {
+    uint64_t* pd = walk(va, 2, WALK_CREATE, flags);
+    if (!pd) return -2;
+    uint64_t* e = &pd[(va >> 21) & 0x1FF];
+    uint64_t old = *e;
     // Set 2MiB page entry
-    l2[l2i] = (pa & ~(PAGE_SIZE_2M - 1)) | PG_PRESENT | PG_RW | PG_PS_2M | (flags & (PG_US|PG_PWT|PG_PCD|PG_GLOBAL));
+    *e = (pa & ~(PAGE_SIZE_2M - 1)) | PG_PRESENT | PG_RW | PG_PS_2M | (flags & LEAF_FLAGS);
+    if ((old & PG_PRESENT) && !(old & PG_PS_2M)) {
+        tlb_flush_tree();
+        free_after_flush((uint64_t)(uintptr_t)entry_table(old), PAGE_SIZE_4K, 0);
+    } else if (old & PG_PRESENT) {
+        tlb_flush_page(va, old);
+    }
+    return 0;
+}
 
-    invlpg((void*)va);
+int map_page_1g(uint64_t va, uint64_t pa, uint64_t flags) {
+    if (!paging_has_1g_pages()) return -1;
+    uint64_t* pdpt = walk(va, 3, WALK_CREATE, flags);
+    if (!pdpt) return -2;
+    uint64_t* e = &pdpt[(va >> 30) & 0x1FF];
+    uint64_t old = *e;
+    *e = (pa & ~(PAGE_SIZE_1G - 1)) | PG_PRESENT | PG_RW | PG_PS_2M | (flags & LEAF_FLAGS);
+    if ((old & PG_PRESENT) && !(old & PG_PS_2M)) {
+        tlb_flush_tree();
+        free_table_tree(entry_table(old), 2);
+    } else if (old & PG_PRESENT) {
+        tlb_flush_page(va, old);
+    }
+    return 0;
+}
+
+int unmap_page_4k(uint64_t va) {
+    // splits a covering large page so that only this 4KiB goes away
+    uint64_t* pt = walk(va, 1, WALK_SPLIT, 0);
+    if (!pt) return -1;
+    uint64_t* e = &pt[(va >> 12) & 0x1FF];
+    uint64_t old = *e;
+    *e = 0;
+    if (old & PG_PRESENT) tlb_flush_page(va, old);
     return 0;
 }
 
 int unmap_page_2m(uint64_t va) {
-    uint64_t l4i = (va >> 39) & 0x1FF;
-    uint64_t l3i = (va >> 30) & 0x1FF;
-    uint64_t l2i = (va >> 21) & 0x1FF;
-    uint64_t* l4 = (uint64_t*)((uint64_t)page_table_l4);
-    if (!(l4[l4i] & PG_PRESENT)) return -1;
-    uint64_t* l3 = (uint64_t*)(l4[l4i] & ~0xFFFULL);
-    if (!(l3[l3i] & PG_PRESENT)) return -1;
-    uint64_t* l2 = (uint64_t*)(l3[l3i] & ~0xFFFULL);
-    l2[l2i] = 0;
-    invlpg((void*)va);
+    uint64_t* pd = walk(va, 2, WALK_LOOKUP, 0);
+    if (!pd) return -1;
+    uint64_t* e = &pd[(va >> 21) & 0x1FF];
+    uint64_t old = *e;
+    *e = 0;
+    if ((old & PG_PRESENT) && !(old & PG_PS_2M)) {
+        tlb_flush_tree();
+        free_after_flush((uint64_t)(uintptr_t)entry_table(old), PAGE_SIZE_4K, 0);
+    } else if (old & PG_PRESENT) {
+        tlb_flush_page(va, old);
+    }
     return 0;
 }
 
+int map_range(uint64_t va, uint64_t pa, uint64_t size, uint64_t flags) {
+    if ((va | pa | size) & (PAGE_SIZE_4K - 1)) return -1;
+    uint64_t done = 0;
+    paging_batch_begin();
+    while (done < size) {
+        uint64_t v = va + done, p = pa + done, left = size - done;
+        int r;
+        uint64_t step;
+        if (has_1g_pages > 0 && !((v | p) & (PAGE_SIZE_1G - 1)) && left >= PAGE_SIZE_1G) {
+            step = PAGE_SIZE_1G; r = map_page_1g(v, p, flags);
+        } else if (!((v | p) & (PAGE_SIZE_2M - 1)) && left >= PAGE_SIZE_2M) {
+            step = PAGE_SIZE_2M; r = map_page_2m(v, p, flags);
+        } else {
+            step = PAGE_SIZE_4K; r = map_page_4k(v, p, flags);
+        }
+        if (r != 0) {
+            unmap_range(va, done);
+            paging_batch_commit();
+            return -2;
+        }
+        done += step;
+    }
+    paging_batch_commit();
+    return 0;
+}
 
+static int table_empty(const uint64_t* t) {
+    for (size_t i = 0; i < PT_ENTRIES; i++) if (t[i]) return 0;
+    return 1;
+}
+
+int unmap_range_release(uint64_t va, uint64_t size, void (*release)(uint64_t pa, uint64_t bytes)) {
+    if ((va | size) & (PAGE_SIZE_4K - 1)) return -1;
+    uint64_t end = va + size;
+    int r = 0;
+    paging_batch_begin();
+    while (va < end) {
+        uint64_t* t = (uint64_t*)((uint64_t)page_table_l4);
+        uint64_t* path[5];  // path[l]: entry at level l on the way to va
+        uint64_t span = 0;
+        int l;
+        // find the entry that maps va and the size it covers
+        for (l = 4; l >= 1; l--) {
+            path[l] = &t[(va >> (12 + 9 * (l - 1))) & 0x1FF];
+            span = 1ULL << (12 + 9 * (l - 1));
+            if (!(*path[l] & PG_PRESENT) || l == 1 || (l < 4 && (*path[l] & PG_PS_2M))) break;
+            t = entry_table(*path[l]);
+        }
+        uint64_t next = (va & ~(span - 1)) + span;
+        int whole = !(*path[l] & PG_PRESENT) || ((va & (span - 1)) == 0 && next <= end);
+        if (whole) {
+            if (*path[l] & PG_PRESENT) {
+                uint64_t old = *path[l];
+                *path[l] = 0;
+                tlb_flush_page(va, old);
+                if (release) free_after_flush(old & PTE_ADDR_MASK & ~(span - 1), span, release);
+            }
+            // past the last entry of a table in the range: drop tables left empty
+            for (int k = l; k < 4; k++) {
+                uint64_t tspan = span << (9 * (k - l + 1));
+                if ((next & (tspan - 1)) && next < end) break;
+                uint64_t* tbl = entry_table(*path[k + 1]);
+                if (!table_empty(tbl)) break;
+                *path[k + 1] = 0;
+                tlb_flush_page(va, 0);   // drop cached paging-structure entries
+                free_after_flush((uint64_t)(uintptr_t)tbl, PAGE_SIZE_4K, 0);
+            }
+            va = next;
+        } else {
+            // partially covered large page: unmap its 4KiB pieces
+            if (unmap_page_4k(va) != 0) { r = -2; break; }
+            va += PAGE_SIZE_4K;
+        }
+    }
+    paging_batch_commit();
+    return r;
+}
+
+int unmap_range(uint64_t va, uint64_t size) {
+    return unmap_range_release(va, size, 0);
+}
+
+uint64_t virt_to_phys(uint64_t va) {
+    uint64_t* t = (uint64_t*)((uint64_t)page_table_l4);
+    for (int l = 4; l >= 1; l--) {
+        uint64_t e = t[(va >> (12 + 9 * (l - 1))) & 0x1FF];
+        if (!(e & PG_PRESENT)) return 0;
+        if (l == 1 || (l < 4 && (e & PG_PS_2M))) {
+            uint64_t span = 1ULL << (12 + 9 * (l - 1));
+            return (e & PTE_ADDR_MASK & ~(span - 1)) | (va & (span - 1));
+        }
+        t = entry_table(e);
+    }
+    return 0;
+}
+
+static ssize_t paging_show_tlb(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    size_t pos = sysfs_emit_at(buf, size, 0, "invlpg %lu\n", (unsigned long)tlb_stats.invlpg);
+    pos = sysfs_emit_at(buf, size, pos, "full_flushes %lu\n", (unsigned long)tlb_stats.full_flushes);
+    pos = sysfs_emit_at(buf, size, pos, "batches %lu\n", (unsigned long)tlb_stats.batches);
+    pos = sysfs_emit_at(buf, size, pos, "deferred %lu\n", (unsigned long)tlb_stats.deferred);
+    pos = sysfs_emit_at(buf, size, pos, "page_tables %lu\n", (unsigned long)tables_in_use);
+    return (ssize_t)pos;
+}
+
+static ssize_t paging_show_threshold(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    return (ssize_t)sysfs_emit_at(buf, size, 0, "%lu\n", (unsigned long)tlb_flush_threshold);
+}
+
+static ssize_t paging_store_threshold(const char *buf, size_t size, void *priv) {
+    (void)priv;
+    unsigned long v;
+    if (sysfs_parse_ulong(buf, size, &v) != 0) return -1;
+    paging_set_flush_threshold((size_t)v);
+    return (ssize_t)size;
+}
+
+void paging_sysfs_init(void) {
+    struct sysfs_attr attr_tlb = { paging_show_tlb, NULL, NULL };
+    struct sysfs_attr attr_threshold = { paging_show_threshold, paging_store_threshold, NULL };
+    sysfs_create_file("/sys/kernel/mm/tlb", &attr_tlb);
+    sysfs_create_file("/sys/kernel/mm/tlb_flush_threshold", &attr_threshold);
+}
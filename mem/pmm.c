@@ -0,0 +1,406 @@
+// Called from the page-fault path (demand-zero pages): no SSE here
+#pragma GCC target("general-regs-only")
+
+#include "../inc/pmm.h"
+#include "../inc/sysfs.h"
+#include <string.h>
+#include <stdint.h>
+
+// Buddy allocator over physical frames. Every frame has one byte in frame_map:
+// the head frame of a free block carries FRAME_FREE | order, the head of an
+// allocated block carries FRAME_HEAD | order, all other frames are 0. Free
+// blocks are linked through their own first bytes (the memory is identity
+// mapped), so the only metadata is the map, which is carved out of RAM itself.
+// The free lists are only touched with interrupts disabled: the page-fault
+// handler allocates frames for demand-zero regions and may interrupt any
+// other allocation.
+
+#define FRAME_FREE       0x80
+#define FRAME_HEAD       0x40
+#define FRAME_ORDER      0x0F
+
+#define PMM_LIMIT        0x100000000ULL   // end of the boot identity map (4 GiB)
+#define LOW_RESERVED     0x100000ULL      // BIOS/real-mode area
+#define MAX_RESERVED     16
+
+#define MB2_MAGIC        0x36d76289u
+#define MB2_TAG_END      0
+#define MB2_TAG_MODULE   3
+#define MB2_TAG_MEMINFO  4
+#define MB2_TAG_MMAP     6
+#define MB2_MEM_AVAILABLE 1
+
+typedef struct free_block {
+    struct free_block* next;
+    struct free_block* prev;
+} free_block_t;
+
+struct phys_range { uint64_t start, end; };
+
+static uint8_t*      frame_map = 0;
+static uint64_t      nframes = 0;
+static free_block_t* free_area[PMM_MAX_ORDER + 1];
+static size_t        free_count[PMM_MAX_ORDER + 1];
+static size_t        managed_frames = 0;
+static size_t        free_frames = 0;
+static int           pmm_ready = 0;
+
+// Pre-zeroed frames: idle time takes free order 0/1 blocks, clears them with
+// interrupts enabled and parks them here; pmm_alloc_zeroed serves from these
+// lists first. Parked blocks count as allocated and are given back to the buddy
+// lists when a normal allocation would fail otherwise.
+#define ZERO_ORDERS      2
+#define ZERO_MIN_FREE    1024     // leave at least 4 MiB free before filling the pool
+static const size_t zero_target[ZERO_ORDERS] = { 256, 32 };   // 1 MiB + 256 KiB
+static free_block_t*   zero_pool[ZERO_ORDERS];
+static size_t          zero_count[ZERO_ORDERS];
+static struct pmm_zero_stats zstats;
+
+static struct phys_range reserved[MAX_RESERVED];
+static int               nreserved = 0;
+
+extern uint8_t _end[];
+
+static inline free_block_t* frame_ptr(uint64_t pfn) {
+    return (free_block_t*)(uintptr_t)(pfn * PMM_FRAME_SIZE);
+}
+
+static void add_reserved(uint64_t start, uint64_t end) {
+    if (end <= start || nreserved >= MAX_RESERVED) return;
+    reserved[nreserved].start = start & ~(PMM_FRAME_SIZE - 1);
+    reserved[nreserved].end = (end + PMM_FRAME_SIZE - 1) & ~(PMM_FRAME_SIZE - 1);
+    nreserved++;
+}
+
+static int overlaps_reserved(uint64_t start, uint64_t end) {
+    for (int i = 0; i < nreserved; i++)
+        if (start < reserved[i].end && reserved[i].start < end) return 1;
+    return 0;
+}
+
+static void list_add(uint64_t pfn, unsigned order) {
+    free_block_t* b = frame_ptr(pfn);
+    b->prev = 0;
+    b->next = free_area[order];
+    if (b->next) b->next->prev = b;
+    free_area[order] = b;
+    free_count[order]++;
+    frame_map[pfn] = (uint8_t)(FRAME_FREE | order);
+}
+
+static void list_del(uint64_t pfn, unsigned order) {
+    free_block_t* b = frame_ptr(pfn);
+    if (b->prev) b->prev->next = b->next; else free_area[order] = b->next;
+    if (b->next) b->next->prev = b->prev;
+    free_count[order]--;
+    frame_map[pfn] = 0;
+}
+
+// Insert a free block, merging with its buddy for as long as the buddy is free too
+static void free_block(uint64_t pfn, unsigned order) {
+    while (order < PMM_MAX_ORDER) {
+        uint64_t buddy = pfn ^ (1ULL << order);
+        if (buddy >= nframes || frame_map[buddy] != (FRAME_FREE | order)) break;
+        list_del(buddy, order);
+        pfn &= ~(1ULL << order);
+        order++;
+    }
+    list_add(pfn, order);
+}
+
+// Walk the multiboot2 tags and hand every available RAM region to 'fn'
+typedef void (*region_fn)(uint64_t start, uint64_t end);
+
+static void walk_memory(uint32_t info, region_fn fn) {
+    uint8_t* p = (uint8_t*)(uintptr_t)info;
+    uint32_t total_size = *(uint32_t*)p;
+    uint32_t offset = 8;
+    int have_mmap = 0;
+    uint64_t meminfo_end = 0;
+    while (offset + 8 <= total_size) {
+        uint32_t tag_type = *(uint32_t*)(p + offset);
+        uint32_t tag_size = *(uint32_t*)(p + offset + 4);
+        if (tag_type == MB2_TAG_END) break;
+        if (tag_type == MB2_TAG_MMAP) {
+            // entry_size(u32) entry_version(u32), then {u64 base, u64 len, u32 type, u32 reserved}
+            uint32_t entry_size = *(uint32_t*)(p + offset + 8);
+            if (entry_size >= 24) {
+                have_mmap = 1;
+                for (uint32_t e = 16; e + entry_size <= tag_size; e += entry_size) {
+                    uint8_t* ent = p + offset + e;
+                    uint64_t base = *(uint64_t*)ent;
+                    uint64_t len  = *(uint64_t*)(ent + 8);
+                    if (*(uint32_t*)(ent + 16) == MB2_MEM_AVAILABLE) fn(base, base + len);
+                }
+            }
+        } else if (tag_type == MB2_TAG_MEMINFO) {
+            // mem_upper is KiB above 1 MiB
+            meminfo_end = LOW_RESERVED + (uint64_t)*(uint32_t*)(p + offset + 12) * 1024;
+        }
+        offset += (tag_size + 7) & ~7u;
+    }
+    // no memory map: fall back to the contiguous region reported by basic meminfo
+    if (!have_mmap && meminfo_end > LOW_RESERVED) fn(LOW_RESERVED, meminfo_end);
+}
+
+// Boot modules (initfs) stay in place until they are unpacked, so keep them out of the pool
+static void reserve_modules(uint32_t info) {
+    uint8_t* p = (uint8_t*)(uintptr_t)info;
+    uint32_t total_size = *(uint32_t*)p;
+    uint32_t offset = 8;
+    while (offset + 8 <= total_size) {
+        uint32_t tag_type = *(uint32_t*)(p + offset);
+        uint32_t tag_size = *(uint32_t*)(p + offset + 4);
+        if (tag_type == MB2_TAG_END) break;
+        if (tag_type == MB2_TAG_MODULE)
+            add_reserved(*(uint32_t*)(p + offset + 8), *(uint32_t*)(p + offset + 12));
+        offset += (tag_size + 7) & ~7u;
+    }
+}
+
+static uint64_t mem_top = 0;
+
+static void note_top(uint64_t start, uint64_t end) {
+    (void)start;
+    if (end > mem_top) mem_top = end;
+}
+
+static uint64_t map_bytes = 0;
+static uint64_t map_at = 0;
+
+// Place the frame map at the highest spot of an available region that fits
+static void find_map_spot(uint64_t start, uint64_t end) {
+    if (end > PMM_LIMIT) end = PMM_LIMIT;
+    start = (start + PMM_FRAME_SIZE - 1) & ~(PMM_FRAME_SIZE - 1);
+    end &= ~(PMM_FRAME_SIZE - 1);
+    if (end <= start || end - start < map_bytes) return;
+    uint64_t at = (end - map_bytes) & ~(PMM_FRAME_SIZE - 1);
+    while (at >= start && overlaps_reserved(at, at + map_bytes)) {
+        if (at < start + PMM_FRAME_SIZE) return;
+        at -= PMM_FRAME_SIZE;
+    }
+    if (at >= start && at > map_at) map_at = at;
+}
+
+// Free every frame of an available region that is not reserved, largest blocks first
+static void add_region(uint64_t start, uint64_t end) {
+    if (end > PMM_LIMIT) end = PMM_LIMIT;
+    uint64_t pfn = (start + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint64_t last = end / PMM_FRAME_SIZE;
+    while (pfn < last) {
+        int order = PMM_MAX_ORDER;
+        while (order > 0 && ((pfn & ((1ULL << order) - 1)) || pfn + (1ULL << order) > last)) order--;
+        while (order > 0 && overlaps_reserved(pfn * PMM_FRAME_SIZE, (pfn + (1ULL << order)) * PMM_FRAME_SIZE)) order--;
+        if (!overlaps_reserved(pfn * PMM_FRAME_SIZE, (pfn + 1) * PMM_FRAME_SIZE)) {
+            free_block(pfn, (unsigned)order);
+            managed_frames += 1ULL << order;
+            free_frames += 1ULL << order;
+        }
+        pfn += 1ULL << order;
+    }
+}
+
+void pmm_init(uint32_t multiboot_magic, uint32_t multiboot_info) {
+    pmm_ready = 0;
+    if (multiboot_magic != MB2_MAGIC || multiboot_info == 0) return;
+
+    nreserved = 0;
+    add_reserved(0, LOW_RESERVED);
+    add_reserved(LOW_RESERVED, (uint64_t)(uintptr_t)_end);
+    add_reserved(multiboot_info, (uint64_t)multiboot_info + *(uint32_t*)(uintptr_t)multiboot_info);
+    reserve_modules(multiboot_info);
+
+    mem_top = 0;
+    walk_memory(multiboot_info, note_top);
+    if (mem_top > PMM_LIMIT) mem_top = PMM_LIMIT;
+    nframes = mem_top / PMM_FRAME_SIZE;
+    if (nframes == 0) return;
+
+    map_bytes = (nframes + PMM_FRAME_SIZE - 1) & ~(PMM_FRAME_SIZE - 1);
+    map_at = 0;
+    walk_memory(multiboot_info, find_map_spot);
+    if (map_at == 0) return;
+    frame_map = (uint8_t*)(uintptr_t)map_at;
+    memset(frame_map, 0, nframes);
+    add_reserved(map_at, map_at + map_bytes);
+
+    memset(free_area, 0, sizeof(free_area));
+    memset(free_count, 0, sizeof(free_count));
+    managed_frames = free_frames = 0;
+    walk_memory(multiboot_info, add_region);
+    pmm_ready = 1;
+}
+
+static inline unsigned long irq_save(void) {
+    unsigned long flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void irq_restore(unsigned long flags) {
+    __asm__ volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+void pmm_reserve_range(uint64_t base, uint64_t len) {
+    if (!pmm_ready || len == 0) return;
+    uint64_t pfn = base / PMM_FRAME_SIZE;
+    uint64_t last = (base + len + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    if (last > nframes) last = nframes;
+    unsigned long flags = irq_save();
+    for (; pfn < last; pfn++) {
+        // find the free block containing this frame and split it down around it
+        for (unsigned order = 0; order <= PMM_MAX_ORDER; order++) {
+            uint64_t head = pfn & ~((1ULL << order) - 1);
+            if (frame_map[head] != (FRAME_FREE | order)) continue;
+            list_del(head, order);
+            while (order > 0) {
+                order--;
+                uint64_t half = head + (1ULL << order);
+                if (pfn >= half) { list_add(head, order); head = half; }
+                else list_add(half, order);
+            }
+            free_frames--;
+            managed_frames--;
+            break;
+        }
+    }
+    irq_restore(flags);
+}
+
+static void zero_pool_drain(void);
+
+uint64_t pmm_alloc_pages(unsigned order) {
+    if (!pmm_ready || order > PMM_MAX_ORDER) return 0;
+    unsigned long flags = irq_save();
+    unsigned o = order;
+    while (o <= PMM_MAX_ORDER && !free_area[o]) o++;
+    if (o > PMM_MAX_ORDER && (zero_count[0] || zero_count[1])) {
+        zero_pool_drain();
+        for (o = order; o <= PMM_MAX_ORDER && !free_area[o]; o++) ;
+    }
+    if (o > PMM_MAX_ORDER) {
+        irq_restore(flags);
+        return 0;
+    }
+    uint64_t pfn = (uint64_t)(uintptr_t)free_area[o] / PMM_FRAME_SIZE;
+    list_del(pfn, o);
+    // split, returning the upper halves to the lower orders
+    while (o > order) {
+        o--;
+        list_add(pfn + (1ULL << o), o);
+    }
+    frame_map[pfn] = (uint8_t)(FRAME_HEAD | order);
+    free_frames -= 1ULL << order;
+    irq_restore(flags);
+    return pfn * PMM_FRAME_SIZE;
+}
+
+void pmm_free_pages(uint64_t pa, unsigned order) {
+    if (!pmm_ready || order > PMM_MAX_ORDER || (pa & (PMM_FRAME_SIZE - 1))) return;
+    uint64_t pfn = pa / PMM_FRAME_SIZE;
+    if (pfn >= nframes) return;
+    unsigned long flags = irq_save();
+    // not ours / double free
+    if (frame_map[pfn] == (FRAME_HEAD | order)) {
+        free_frames += 1ULL << order;
+        free_block(pfn, order);
+    }
+    irq_restore(flags);
+}
+
+static void zero_pool_drain(void) {
+    unsigned long flags = irq_save();
+    for (unsigned o = 0; o < ZERO_ORDERS; o++) {
+        while (zero_pool[o]) {
+            free_block_t* b = zero_pool[o];
+            zero_pool[o] = b->next;
+            zero_count[o]--;
+            pmm_free_pages((uint64_t)(uintptr_t)b, o);
+        }
+    }
+    irq_restore(flags);
+}
+
+uint64_t pmm_alloc_zeroed(unsigned order) {
+    if (order < ZERO_ORDERS) {
+        unsigned long flags = irq_save();
+        free_block_t* b = zero_pool[order];
+        if (b) {
+            zero_pool[order] = b->next;
+            zero_count[order]--;
+        }
+        irq_restore(flags);
+        if (b) {
+            b->next = 0;    // the only word written since the frame was cleared
+            zstats.hits++;
+            return (uint64_t)(uintptr_t)b;
+        }
+    }
+    zstats.misses++;
+    uint64_t pa = pmm_alloc_pages(order);
+    if (pa) memset((void*)(uintptr_t)pa, 0, (size_t)(PMM_FRAME_SIZE << order));
+    return pa;
+}
+
+int pmm_zero_idle(unsigned budget) {
+    int did = 0;
+    while (budget--) {
+        unsigned o = 0;
+        while (o < ZERO_ORDERS && zero_count[o] >= zero_target[o]) o++;
+        if (o >= ZERO_ORDERS || free_frames < ZERO_MIN_FREE) break;
+        uint64_t pa = pmm_alloc_pages(o);
+        if (!pa) break;
+        // the frame is private until it is pooled, so the memset itself needs no
+        // protection; it still runs with interrupts off when called from
+        // thread_idle, which is why the budget per call is kept small
+        memset((void*)(uintptr_t)pa, 0, (size_t)(PMM_FRAME_SIZE << o));
+        free_block_t* b = (free_block_t*)(uintptr_t)pa;
+        unsigned long flags = irq_save();
+        b->next = zero_pool[o];
+        zero_pool[o] = b;
+        zero_count[o]++;
+        irq_restore(flags);
+        zstats.zeroed += 1ULL << o;
+        did = 1;
+    }
+    return did;
+}
+
+void pmm_get_zero_stats(struct pmm_zero_stats* out) {
+    if (!out) return;
+    *out = zstats;
+    out->pooled = zero_count[0] + 2 * zero_count[1];
+}
+
+size_t pmm_total_bytes(void) { return managed_frames * PMM_FRAME_SIZE; }
+size_t pmm_free_bytes(void)  { return free_frames * PMM_FRAME_SIZE; }
+size_t pmm_free_blocks(unsigned order) { return order <= PMM_MAX_ORDER ? free_count[order] : 0; }
+
+static ssize_t pmm_show_buddyinfo(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    // same layout as Linux: one column of free block counts per order
+    size_t pos = sysfs_emit_at(buf, size, 0, "Node 0, zone Normal");
+    for (unsigned o = 0; o <= PMM_MAX_ORDER; o++)
+        pos = sysfs_emit_at(buf, size, pos, " %lu", (unsigned long)free_count[o]);
+    pos = sysfs_emit_at(buf, size, pos, "\n");
+    return (ssize_t)pos;
+}
+
+static ssize_t pmm_show_zeropool(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    size_t pos = sysfs_emit_at(buf, size, 0, "order0 %lu/%lu\n", (unsigned long)zero_count[0], (unsigned long)zero_target[0]);
+    pos = sysfs_emit_at(buf, size, pos, "order1 %lu/%lu\n", (unsigned long)zero_count[1], (unsigned long)zero_target[1]);
+    pos = sysfs_emit_at(buf, size, pos, "hits %lu\n", (unsigned long)zstats.hits);
+    pos = sysfs_emit_at(buf, size, pos, "misses %lu\n", (unsigned long)zstats.misses);
+    pos = sysfs_emit_at(buf, size, pos, "zeroed_in_idle %lu\n", (unsigned long)zstats.zeroed);
+    return (ssize_t)pos;
+}
+
+void pmm_sysfs_init(void) {
+    struct sysfs_attr attr_buddyinfo = { pmm_show_buddyinfo, NULL, NULL };
+    struct sysfs_attr attr_zeropool = { pmm_show_zeropool, NULL, NULL };
+    sysfs_create_file("/sys/kernel/mm/buddyinfo", &attr_buddyinfo);
+    sysfs_create_file("/sys/kernel/mm/zeropool", &attr_zeropool);
+}
@@ -0,0 +1,204 @@
+#include "../inc/slab.h"
+#include "../inc/heap.h"
+#include "../inc/sysfs.h"
+#include <string.h>
+#include <stdint.h>
+
+// Slab layer: every class keeps a list of partially used pages, a list of full
+// pages and a small cache of empty pages. A page starts with a slab_page header;
+// objects follow it. Free objects are chained through their first word, and a
+// fresh page is handed out by bumping 'bump' so no page is ever carved up front.
+// Pages come from the general heap (kmalloc_aligned) and are tracked in a bitmap
+// over the heap window, which is how kfree tells slab objects from heap blocks.
+
+#define SLAB_MAGIC       0x5AB1
+#define SLAB_HDR_SIZE    32
+#define SLAB_EMPTY_KEEP  1      // empty pages cached per class before returning to heap
+
+typedef struct slab_page {
+    uint16_t magic;
+    uint8_t  cls;
+    uint8_t  reserved;
+    uint16_t inuse;
+    uint16_t bump;              // offset of the first never-used object
+    void*    free;              // singly linked list of freed objects
+    struct slab_page* next;
+    struct slab_page* prev;
+} slab_page_t;
+
+typedef struct slab_cache {
+    size_t size;
+    size_t per_page;
+    slab_page_t* partial;
+    slab_page_t* full;
+    slab_page_t* empty;
+    size_t nempty;
+    struct slab_class_stats st;
+} slab_cache_t;
+
+static const size_t class_sizes[SLAB_NUM_CLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+// (size + 15) / 16 -> class index
+static uint8_t size_to_class[SLAB_MAX_SIZE / 16 + 1];
+
+static slab_cache_t caches[SLAB_NUM_CLASSES];
+static uintptr_t slab_base = 0;
+static size_t    slab_span = 0;
+static uint8_t*  page_bitmap = 0;   // one bit per 4 KiB page of the heap window
+static int       slab_ready = 0;
+
+static inline int bitmap_test(uintptr_t addr) {
+    size_t idx = (addr - slab_base) / SLAB_PAGE_SIZE;
+    return (page_bitmap[idx >> 3] >> (idx & 7)) & 1;
+}
+
+static inline void bitmap_set(uintptr_t addr, int on) {
+    size_t idx = (addr - slab_base) / SLAB_PAGE_SIZE;
+    if (on) page_bitmap[idx >> 3] |= (uint8_t)(1u << (idx & 7));
+    else    page_bitmap[idx >> 3] &= (uint8_t)~(1u << (idx & 7));
+}
+
+static void list_push(slab_page_t** list, slab_page_t* pg) {
+    pg->prev = 0;
+    pg->next = *list;
+    if (*list) (*list)->prev = pg;
+    *list = pg;
+}
+
+static void list_remove(slab_page_t** list, slab_page_t* pg) {
+    if (pg->prev) pg->prev->next = pg->next; else *list = pg->next;
+    if (pg->next) pg->next->prev = pg->prev;
+    pg->next = pg->prev = 0;
+}
+
+void slab_init(uintptr_t base, size_t span) {
+    slab_ready = 0;
+    for (int c = 0; c < SLAB_NUM_CLASSES; c++) {
+        memset(&caches[c], 0, sizeof(caches[c]));
+        caches[c].size = class_sizes[c];
+        caches[c].per_page = (SLAB_PAGE_SIZE - SLAB_HDR_SIZE) / class_sizes[c];
+        caches[c].st.obj_size = class_sizes[c];
+        caches[c].st.objs_per_page = caches[c].per_page;
+    }
+    int c = 0;
+    for (size_t i = 0; i <= SLAB_MAX_SIZE / 16; i++) {
+        while (class_sizes[c] < i * 16) c++;
+        size_to_class[i] = (uint8_t)c;
+    }
+    slab_base = base & ~((uintptr_t)SLAB_PAGE_SIZE - 1);
+    slab_span = span + (base - slab_base);
+    // the bitmap itself is large for any sane heap, so it is served by the heap proper
+    size_t bytes = (slab_span / SLAB_PAGE_SIZE + 7) / 8;
+    page_bitmap = (uint8_t*)kcalloc(bytes ? bytes : 1, 1);
+    if (page_bitmap) slab_ready = 1;
+}
+
+int slab_owns(const void* ptr) {
+    uintptr_t a = (uintptr_t)ptr;
+    if (!slab_ready || a < slab_base || a >= slab_base + slab_span) return 0;
+    return bitmap_test(a & ~((uintptr_t)SLAB_PAGE_SIZE - 1));
+}
+
+static inline slab_page_t* page_of(const void* ptr) {
+    return (slab_page_t*)((uintptr_t)ptr & ~((uintptr_t)SLAB_PAGE_SIZE - 1));
+}
+
+size_t slab_obj_size(const void* ptr) {
+    return caches[page_of(ptr)->cls].size;
+}
+
+void* slab_alloc(size_t size) {
+    if (!slab_ready || size == 0 || size > SLAB_MAX_SIZE) return 0;
+    slab_cache_t* sc = &caches[size_to_class[(size + 15) >> 4]];
+    slab_page_t* pg = sc->partial;
+    if (pg) {
+        sc->st.hits++;
+    } else if (sc->empty) {
+        pg = sc->empty;
+        list_remove(&sc->empty, pg);
+        sc->nempty--;
+        list_push(&sc->partial, pg);
+        sc->st.hits++;
+    } else {
+        pg = (slab_page_t*)kmalloc_aligned(SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+        if (!pg) return 0;
+        pg->magic = SLAB_MAGIC;
+        pg->cls = (uint8_t)(sc - caches);
+        pg->reserved = 0;
+        pg->inuse = 0;
+        pg->bump = SLAB_HDR_SIZE;
+        pg->free = 0;
+        bitmap_set((uintptr_t)pg, 1);
+        list_push(&sc->partial, pg);
+        sc->st.pages++;
+        sc->st.misses++;
+    }
+
+    void* obj;
+    if (pg->free) {
+        obj = pg->free;
+        pg->free = *(void**)obj;
+    } else {
+        obj = (uint8_t*)pg + pg->bump;
+        pg->bump = (uint16_t)(pg->bump + sc->size);
+    }
+    pg->inuse++;
+    if (pg->inuse == sc->per_page) {
+        list_remove(&sc->partial, pg);
+        list_push(&sc->full, pg);
+    }
+    sc->st.active++;
+    return obj;
+}
+
+void slab_free(void* ptr) {
+    slab_page_t* pg = page_of(ptr);
+    if (pg->magic != SLAB_MAGIC) return;
+    slab_cache_t* sc = &caches[pg->cls];
+    if (pg->inuse == sc->per_page) {
+        list_remove(&sc->full, pg);
+        list_push(&sc->partial, pg);
+    }
+    *(void**)ptr = pg->free;
+    pg->free = ptr;
+    pg->inuse--;
+    sc->st.active--;
+    sc->st.frees++;
+    if (pg->inuse == 0) {
+        list_remove(&sc->partial, pg);
+        if (sc->nempty < SLAB_EMPTY_KEEP) {
+            list_push(&sc->empty, pg);
+            sc->nempty++;
+        } else {
+            bitmap_set((uintptr_t)pg, 0);
+            pg->magic = 0;
+            sc->st.pages--;
+            kfree(pg);
+        }
+    }
+}
+
+int slab_get_stats(int cls, struct slab_class_stats* out) {
+    if (cls < 0 || cls >= SLAB_NUM_CLASSES || !out) return -1;
+    *out = caches[cls].st;
+    return 0;
+}
+
+static ssize_t slab_show_slabinfo(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    size_t pos = sysfs_emit_at(buf, size, 0, "class size active total pages hits misses frees\n");
+    for (int c = 0; c < SLAB_NUM_CLASSES; c++) {
+        const struct slab_class_stats* st = &caches[c].st;
+        pos = sysfs_emit_at(buf, size, pos, "kmalloc-%lu %lu %lu %lu %lu %lu %lu %lu\n",
+            (unsigned long)st->obj_size, (unsigned long)st->obj_size,
+            (unsigned long)st->active, (unsigned long)(st->pages * st->objs_per_page),
+            (unsigned long)st->pages, (unsigned long)st->hits,
+            (unsigned long)st->misses, (unsigned long)st->frees);
+    }
+    return (ssize_t)pos;
+}
+
+void slab_sysfs_init(void) {
+    struct sysfs_attr attr_slabinfo = { slab_show_slabinfo, NULL, NULL };
+    sysfs_create_file("/sys/kernel/mm/slabinfo", &attr_slabinfo);
+}
@@ -0,0 +1,165 @@
+// vm_handle_fault runs inside #PF, possibly in the middle of a
+// kernel_fpu_begin/end section, so it must not touch xmm registers
+#pragma GCC target("general-regs-only")
+
+#include "../inc/vm.h"
+#include "../inc/paging.h"
+#include "../inc/pmm.h"
+#include "../inc/sysfs.h"
+#include <string.h>
+#include <stdint.h>
+
+// Demand-zero regions live in their own window of kernel address space (PML4
+// slot 2, above the heap window). The region table is a small array kept
+// sorted by address; reservations are first fit over the gaps between regions
+// and leave one unmapped guard page behind every region.
+// No thread safety assumed (callers should serialize); the fault path only reads the table.
+
+#define VM_WINDOW_BASE   0x0000010000000000ULL
+#define VM_WINDOW_SIZE   (256ULL << 30)
+#define VM_MAX_REGIONS   128
+#define VM_GUARD         VM_PAGE_SIZE
+
+#define PF_PRESENT       (1ULL << 0)   // fault on a present page (protection violation)
+#define PF_RSVD          (1ULL << 3)
+
+struct vm_region {
+    uint64_t start;
+    uint64_t size;
+    uint64_t flags;
+    size_t   resident;      // populated pages
+    int      foreign;       // pages mapped by vm_map_frames, not owned
+};
+
+static struct vm_region regions[VM_MAX_REGIONS];
+static size_t nregions = 0;
+static struct vm_stats vstats;
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Region containing addr, or -1
+static int find_region(uint64_t addr) {
+    size_t lo = 0, hi = nregions;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (addr < regions[mid].start) hi = mid;
+        else if (addr >= regions[mid].start + regions[mid].size) lo = mid + 1;
+        else return (int)mid;
+    }
+    return -1;
+}
+
+void* vm_reserve(size_t size, uint64_t flags) {
+    if (size == 0 || nregions >= VM_MAX_REGIONS) return 0;
+    uint64_t len = (size + VM_PAGE_SIZE - 1) & ~(VM_PAGE_SIZE - 1);
+    uint64_t at = VM_WINDOW_BASE;
+    size_t i = 0;
+    for (; i < nregions; i++) {
+        if (at + len + VM_GUARD <= regions[i].start) break;
+        at = regions[i].start + regions[i].size + VM_GUARD;
+    }
+    if (at + len + VM_GUARD > VM_WINDOW_BASE + VM_WINDOW_SIZE) return 0;
+    memmove(&regions[i + 1], &regions[i], (nregions - i) * sizeof(regions[0]));
+    regions[i].start = at;
+    regions[i].size = len;
+    regions[i].flags = flags & (PG_US | PG_PWT | PG_PCD);
+    regions[i].resident = 0;
+    regions[i].foreign = 0;
+    nregions++;
+    vstats.regions = nregions;
+    vstats.reserved += len;
+    return (void*)(uintptr_t)at;
+}
+
+static void release_frame(uint64_t pa, uint64_t bytes) {
+    // demand-zero pages are always single 4 KiB frames
+    if (bytes == VM_PAGE_SIZE) pmm_free_page(pa);
+}
+
+void vm_release(void* addr) {
+    int i = find_region((uint64_t)(uintptr_t)addr);
+    if (i < 0 || regions[i].start != (uint64_t)(uintptr_t)addr) return;
+    unmap_range_release(regions[i].start, regions[i].size, regions[i].foreign ? 0 : release_frame);
+    vstats.reserved -= regions[i].size;
+    vstats.resident -= regions[i].resident * VM_PAGE_SIZE;
+    memmove(&regions[i], &regions[i + 1], (nregions - (size_t)i - 1) * sizeof(regions[0]));
+    nregions--;
+    vstats.regions = nregions;
+}
+
+void* vm_map_frames(const uint64_t* frames, size_t count, uint64_t flags) {
+    if (!frames || count == 0) return 0;
+    uint64_t va = (uint64_t)(uintptr_t)vm_reserve(count * VM_PAGE_SIZE, flags);
+    if (!va) return 0;
+    int i = find_region(va);
+    regions[i].foreign = 1;
+    paging_batch_begin();
+    for (size_t k = 0; k < count; k++) {
+        if (map_page_4k(va + k * VM_PAGE_SIZE, frames[k], PG_PRESENT | PG_RW | regions[i].flags) != 0) {
+            paging_batch_commit();
+            vm_release((void*)(uintptr_t)va);
+            return 0;
+        }
+    }
+    paging_batch_commit();
+    return (void*)(uintptr_t)va;
+}
+
+size_t vm_region_size(const void* addr) {
+    int i = find_region((uint64_t)(uintptr_t)addr);
+    if (i < 0 || regions[i].start != (uint64_t)(uintptr_t)addr) return 0;
+    return regions[i].size;
+}
+
+int vm_owns(const void* addr) {
+    return find_region((uint64_t)(uintptr_t)addr) >= 0;
+}
+
+int vm_handle_fault(uint64_t addr, uint64_t error_code) {
+    if (error_code & (PF_PRESENT | PF_RSVD)) return -1;
+    if (addr < VM_WINDOW_BASE || addr >= VM_WINDOW_BASE + VM_WINDOW_SIZE) return -1;
+    uint64_t t0 = rdtsc();
+    int i = find_region(addr);
+    if (i < 0 || regions[i].foreign) return -1;
+    uint64_t pa = pmm_alloc_zeroed(0);
+    if (!pa) { vstats.failed++; return -1; }
+    if (map_page_4k(addr & ~(VM_PAGE_SIZE - 1), pa, PG_PRESENT | PG_RW | regions[i].flags) != 0) {
+        pmm_free_page(pa);
+        vstats.failed++;
+        return -1;
+    }
+    regions[i].resident++;
+    vstats.resident += VM_PAGE_SIZE;
+    vstats.faults++;
+    uint64_t dt = rdtsc() - t0;
+    vstats.cycles_total += dt;
+    if (dt > vstats.cycles_max) vstats.cycles_max = dt;
+    return 0;
+}
+
+void vm_get_stats(struct vm_stats* out) {
+    if (out) *out = vstats;
+}
+
+static ssize_t vm_show_stats(char *buf, size_t size, void *priv) {
+    (void)priv;
+    if (!buf || size == 0) return 0;
+    size_t pos = sysfs_emit_at(buf, size, 0, "faults %lu\n", (unsigned long)vstats.faults);
+    pos = sysfs_emit_at(buf, size, pos, "failed %lu\n", (unsigned long)vstats.failed);
+    pos = sysfs_emit_at(buf, size, pos, "fault_cycles_avg %lu\n",
+        (unsigned long)(vstats.faults ? vstats.cycles_total / vstats.faults : 0));
+    pos = sysfs_emit_at(buf, size, pos, "fault_cycles_max %lu\n", (unsigned long)vstats.cycles_max);
+    pos = sysfs_emit_at(buf, size, pos, "regions %lu\n", (unsigned long)vstats.regions);
+    pos = sysfs_emit_at(buf, size, pos, "reserved_kb %lu\n", (unsigned long)(vstats.reserved / 1024));
+    pos = sysfs_emit_at(buf, size, pos, "resident_kb %lu\n", (unsigned long)(vstats.resident / 1024));
+    return (ssize_t)pos;
+}
+
+void vm_sysfs_init(void) {
+    struct sysfs_attr attr_vm = { vm_show_stats, NULL, NULL };
+    sysfs_create_file("/sys/kernel/mm/vm", &attr_vm);
+}
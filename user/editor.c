@@ -704,22 +704,16 @@ static int file_load(Editor *E, const char *path) {
 	struct fs_file *f = fs_open(path);
 	if (!f) return -1;
     char *buf = 0;
+    const char *text = 0;
+    struct fs_map view = {0};
     size_t sz = f->size;
     if (sz > 0) {
-        buf = (char*)kmalloc(sz + 1);
-        if (!buf) { fs_file_free(f); return -1; }
-        ssize_t rd = fs_read(f, buf, sz, 0);
-        if (rd < 0) { kfree(buf); fs_file_free(f); return -1; }
+        /* parse straight out of the file's backing store; no full-size copy */
+        if (fs_mmap(f, 0, sz, &view) != 0) { fs_file_free(f); return -1; }
         /* Treat embedded NUL as logical end of text file.
            This hides padding/garbage bytes from cpio archives. */
-        if (rd > 0) {
-            size_t used = strnlen(buf, (size_t)rd);
-            sz = used;
-            buf[used] = '\0';
-        } else {
-            buf[0] = '\0';
-            sz = 0;
-        }
+        text = (const char*)view.addr;
+        sz = view.len ? strnlen(text, view.len) : 0;
     } else {
         // fallback: unknown size, read in chunks until EOF
         size_t cap = 4096; buf = (char*)kmalloc(cap + 1); if (!buf) { fs_file_free(f); return -1; }
@@ -737,28 +731,30 @@ static int file_load(Editor *E, const char *path) {
         } else {
             buf[0] = '\0';
         }
+        text = buf;
     }
-	fs_file_free(f);
 	// parse into lines
 	buf_clear(E);
-	if (!buf || sz == 0) { if (buf) kfree(buf); return 0; }
+	if (!text || sz == 0) { if (buf) kfree(buf); fs_munmap(&view); fs_file_free(f); return 0; }
 	// count lines
-	int lines = 1; for (size_t i=0;i<sz;i++) if (buf[i]=='\n') lines++;
+	int lines = 1; for (size_t i=0;i<sz;i++) if (text[i]=='\n') lines++;
 	buf_ensure_lines(E, lines);
 	E->line_count = 0;
 	size_t i = 0; while (i < sz) {
 		// extract line up to \n (handle CRLF)
-		size_t start = i; while (i < sz && buf[i] != '\n') i++;
+		size_t start = i; while (i < sz && text[i] != '\n') i++;
 		size_t end = i; // [start,end)
-		if (end > start && buf[end-1] == '\r') end--;
+		if (end > start && text[end-1] == '\r') end--;
 		Line L = {0}; L.cap = (end - start) + 16; L.data = (char*)kcalloc(L.cap, 1); L.len = (end - start);
-		if (L.len) memcpy(L.data, buf + start, L.len);
+		if (L.len) memcpy(L.data, text + start, L.len);
 		E->lines[E->line_count++] = L;
-		if (i < sz && buf[i] == '\n') i++;
+		if (i < sz && text[i] == '\n') i++;
 	}
 	if (E->line_count == 0) { E->line_count = 1; E->lines[0].data = (char*)kcalloc(16,1); E->lines[0].len=0; E->lines[0].cap=16; }
 	E->cursor_row = 0; E->cursor_col = 0; E->view_top = 0; E->view_left = 0; E->modified = 0;
-	kfree(buf);
+	if (buf) kfree(buf);
+	fs_munmap(&view);
+	fs_file_free(f);
 	return 0;
 }
 